@@ -0,0 +1,92 @@
+#include "AhoCorasick.h"
+
+#include <deque>
+
+namespace {
+const uint32_t kNone = UINT32_MAX;
+}
+
+AhoCorasick::AhoCorasick() : next_(256, kNone), pattern_ids_(1) {}
+
+void AhoCorasick::add(std::string_view pattern, uint32_t id) {
+  if (pattern.empty())
+    return;
+  uint32_t state = 0;
+  for (unsigned char c : pattern) {
+    uint32_t &target = next_[state * 256 + c];
+    if (target == kNone) {
+      target = static_cast<uint32_t>(pattern_ids_.size());
+      pattern_ids_.emplace_back();
+      next_.resize(next_.size() + 256, kNone);
+    }
+    state = next_[state * 256 + c];
+  }
+  pattern_ids_[state].push_back(id);
+}
+
+void AhoCorasick::compile() {
+  std::vector<uint32_t> fail(pattern_ids_.size(), 0);
+  std::deque<uint32_t> queue;
+  for (uint32_t c = 0; c < 256; ++c) {
+    uint32_t &target = next_[c];
+    if (target == kNone) {
+      target = 0;
+    } else {
+      queue.push_back(target);
+    }
+  }
+  // breadth first, so the failure state of a state is complete before the state is
+  std::vector<uint32_t> order;
+  while (!queue.empty()) {
+    uint32_t state = queue.front();
+    queue.pop_front();
+    order.push_back(state);
+    for (uint32_t c = 0; c < 256; ++c) {
+      uint32_t &target = next_[state * 256 + c];
+      uint32_t fallback = next_[fail[state] * 256 + c];
+      if (target == kNone) {
+        target = fallback;
+      } else {
+        fail[target] = fallback;
+        queue.push_back(target);
+      }
+    }
+  }
+  for (uint32_t state : order) {
+    const auto &inherited = pattern_ids_[fail[state]];
+    pattern_ids_[state].insert(pattern_ids_[state].end(), inherited.begin(), inherited.end());
+  }
+  // bytes absent from the patterns lead back to the root from every state, they share a column
+  std::array<bool, 256> used{};
+  for (uint32_t c = 0; c < 256; ++c) {
+    used[c] = next_[c] != 0;
+  }
+  for (uint32_t state : order) {
+    for (uint32_t c = 0; c < 256; ++c) {
+      used[c] = used[c] || next_[state * 256 + c] != 0;
+    }
+  }
+  columns_ = 1;
+  for (uint32_t c = 0; c < 256; ++c) {
+    column_[c] = used[c] ? static_cast<uint16_t>(columns_++) : 0;
+  }
+  std::vector<uint32_t> compact(pattern_ids_.size() * columns_, 0);
+  for (uint32_t state = 0; state < pattern_ids_.size(); ++state) {
+    for (uint32_t c = 0; c < 256; ++c) {
+      compact[state * columns_ + column_[c]] = next_[state * 256 + c];
+    }
+  }
+  next_.swap(compact);
+  output_begin_.assign(1, 0);
+  outputs_.clear();
+  for (const auto &ids : pattern_ids_) {
+    outputs_.insert(outputs_.end(), ids.begin(), ids.end());
+    output_begin_.push_back(static_cast<uint32_t>(outputs_.size()));
+  }
+  pattern_ids_.clear();
+  pattern_ids_.shrink_to_fit();
+}
+
+bool AhoCorasick::empty() const {
+  return outputs_.empty();
+}
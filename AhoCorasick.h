@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/*
+ * Multi-pattern literal matcher: all patterns are found in one pass over the text,
+ * whatever their number. compile() turns the trie into a dense automaton (failure links
+ * folded in), so scanning is one table lookup per byte. Its columns are the bytes occurring
+ * in the patterns plus one for all others, which keeps the table small enough for the cache.
+ */
+class AhoCorasick {
+ public:
+  AhoCorasick();
+  // The id is reported for every occurrence of the pattern, empty patterns are ignored
+  void add(std::string_view pattern, uint32_t id);
+  void compile();
+  bool empty() const;
+
+  template<typename F>
+  void scan(std::string_view text, F &&on_match) const {
+    uint32_t state = 0;
+    for (unsigned char c : text) {
+      state = next_[state * columns_ + column_[c]];
+      for (uint32_t i = output_begin_[state]; i < output_begin_[state + 1]; ++i) {
+        on_match(outputs_[i]);
+      }
+    }
+  }
+
+ private:
+  std::vector<uint32_t> next_;
+  std::array<uint16_t, 256> column_{};
+  uint32_t columns_ = 256;
+  // ids found on entering state s: outputs_[output_begin_[s] .. output_begin_[s + 1])
+  std::vector<uint32_t> output_begin_;
+  std::vector<uint32_t> outputs_;
+  // before compile(): ids of the patterns ending in each state
+  std::vector<std::vector<uint32_t>> pattern_ids_;
+};
@@ -0,0 +1,82 @@
+#include "ClientRateLimiter.h"
+
+#include <algorithm>
+
+#include "Metrics.h"
+
+namespace {
+// throttled clients run into debt by at most that many bursts, so a pause stays bounded
+const int64_t kMaxDebtBursts = 4;
+
+int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+ClientRateLimiter::Bucket::Bucket(int64_t interval_ns, int64_t tolerance_ns, bool drop,
+                                  std::atomic<uint64_t> &dropped, std::atomic<uint64_t> &throttled)
+    : interval_ns_(interval_ns),
+      tolerance_ns_(tolerance_ns),
+      drop_(drop),
+      dropped_(dropped),
+      throttled_(throttled) {}
+
+bool ClientRateLimiter::Bucket::admit() {
+  int64_t now = nowNs();
+  int64_t tat = tat_ns_.load(std::memory_order_relaxed);
+  for (;;) {
+    int64_t next = std::max(tat, now) + interval_ns_;
+    // throttled clients run into debt instead, they are paused before the next read
+    if (drop_ && next - now > tolerance_ns_) {
+      ++dropped_;
+      return false;
+    }
+    next = std::min(next, now + kMaxDebtBursts * tolerance_ns_);
+    if (tat_ns_.compare_exchange_weak(tat, next, std::memory_order_relaxed))
+      return true;
+  }
+}
+
+std::chrono::nanoseconds ClientRateLimiter::Bucket::delay() {
+  if (drop_)
+    return std::chrono::nanoseconds(0);
+  // until the next message would fit the burst again
+  int64_t wait = tat_ns_.load(std::memory_order_relaxed) + interval_ns_ - tolerance_ns_ - nowNs();
+  if (wait <= 0)
+    return std::chrono::nanoseconds(0);
+  ++throttled_;
+  return std::chrono::nanoseconds(wait);
+}
+
+ClientRateLimiter::ClientRateLimiter(const ClientRateLimitConfig &config)
+    : interval_ns_(config.messages_per_sec > 0 ? static_cast<int64_t>(1e9 / config.messages_per_sec) : 0),
+      tolerance_ns_(interval_ns_ * std::max(1u, config.burst)),
+      drop_(config.action == RateLimitAction::Drop),
+      dropped_(Metrics::instance().counter("ratelimit.dropped")),
+      throttled_(Metrics::instance().counter("ratelimit.throttled")) {}
+
+std::shared_ptr<ClientRateLimiter::Bucket> ClientRateLimiter::forClient(const std::string &client_ip) {
+  if (interval_ns_ == 0)
+    return nullptr;
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &slot = buckets_[client_ip];
+  if (!slot)
+    slot.reset(new Bucket(interval_ns_, tolerance_ns_, drop_, dropped_, throttled_));
+  std::shared_ptr<Bucket> bucket = slot;
+  if (buckets_.size() >= prune_at_)
+    prune();
+  return bucket;
+}
+
+void ClientRateLimiter::prune() {
+  // a bucket nobody holds and that is full again is the same as a new one
+  int64_t now = nowNs();
+  for (auto it = buckets_.begin(); it != buckets_.end();) {
+    if (it->second.use_count() == 1 && it->second->tat_ns_.load(std::memory_order_relaxed) <= now)
+      it = buckets_.erase(it);
+    else
+      ++it;
+  }
+  prune_at_ = std::max<size_t>(1024, buckets_.size() * 2);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// What happens to the messages of a client beyond its rate limit
+enum class RateLimitAction { Throttle, Drop };
+
+struct ClientRateLimitConfig {
+  double messages_per_sec; // 0: unlimited
+  unsigned burst;
+  RateLimitAction action;
+};
+
+/*
+ * Token bucket per client IP, shared by every connection of that client, kept as a
+ * theoretical arrival time (GCRA): each message moves it 1/rate ahead, and a client is over
+ * its limit while that time runs more than burst messages ahead of the clock. One atomic
+ * per client, the message path takes no lock.
+ */
+class ClientRateLimiter {
+ public:
+  class Bucket {
+   public:
+    // Per message: false when it has to be dropped (Drop action)
+    bool admit();
+    // Throttle action: how long to stop reading from the client, zero when within its limit
+    std::chrono::nanoseconds delay();
+
+   private:
+    friend class ClientRateLimiter;
+
+    std::atomic<int64_t> tat_ns_{0};
+    const int64_t interval_ns_;
+    const int64_t tolerance_ns_;
+    const bool drop_;
+    std::atomic<uint64_t> &dropped_;
+    std::atomic<uint64_t> &throttled_;
+
+    Bucket(int64_t interval_ns, int64_t tolerance_ns, bool drop,
+           std::atomic<uint64_t> &dropped, std::atomic<uint64_t> &throttled);
+  };
+
+  explicit ClientRateLimiter(const ClientRateLimitConfig &config);
+  // nullptr when rate limiting is off
+  std::shared_ptr<Bucket> forClient(const std::string &client_ip);
+
+ private:
+  const int64_t interval_ns_;
+  const int64_t tolerance_ns_;
+  const bool drop_;
+  // for all clients together, per client they would grow with every address ever seen
+  std::atomic<uint64_t> &dropped_;
+  std::atomic<uint64_t> &throttled_;
+  std::mutex mutex_;
+  // kept after a disconnect, so reconnecting does not refill the bucket
+  std::unordered_map<std::string, std::shared_ptr<Bucket>> buckets_;
+  size_t prune_at_ = 1024;
+
+  void prune();
+};
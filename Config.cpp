@@ -1,9 +1,70 @@
 #include "Config.h"
+#include <algorithm>
 #include <fstream>
+#include <stdexcept>
+#include <thread>
 #include "json.hpp"
 
 using json = nlohmann::json;
 
+namespace {
+
+// a single string or a list of them
+std::vector<std::string> readStrings(const json &value) {
+  if (value.is_string())
+    return {value.get<std::string>()};
+  std::vector<std::string> strings;
+  if (value.is_array()) {
+    for (const auto &element : value) {
+      if (element.is_string())
+        strings.push_back(element.get<std::string>());
+    }
+  }
+  return strings;
+}
+
+// unknown names stop the server, like an invalid regular expression: the rule would match too much or never
+int readFacility(const std::string &name, const std::string &owner) {
+  int facility = SyslogHeader::facilityCode(name);
+  if (facility < 0)
+    throw std::runtime_error("Unknown facility \"" + name + "\" in " + owner);
+  return facility;
+}
+
+int readSeverity(const std::string &name, const std::string &owner) {
+  int severity = SyslogHeader::severityCode(name);
+  if (severity < 0)
+    throw std::runtime_error("Unknown severity \"" + name + "\" in " + owner);
+  return severity;
+}
+
+void readRuleMatch(const json &match, RuleConfig &rule) {
+  const std::string owner = "rule " + rule.name;
+  rule.hosts = readStrings(match.value("host", json()));
+  rule.app_names = readStrings(match.value("app_name", json()));
+  rule.msgids = readStrings(match.value("msgid", json()));
+  rule.client_ips = readStrings(match.value("client_ip", json()));
+  rule.msg_prefixes = readStrings(match.value("msg_prefix", json()));
+  rule.msg_contains = readStrings(match.value("msg_contains", json()));
+  rule.msg_regex = match.value("msg_regex", rule.msg_regex);
+  std::string facility = match.value("facility", std::string());
+  rule.facility = facility.empty() ? -1 : readFacility(facility, owner);
+  // one name: that severity and the more severe ones, two names: the range between them
+  std::vector<std::string> severities = readStrings(match.value("severity", json()));
+  if (severities.size() == 1) {
+    rule.max_severity = readSeverity(severities[0], owner);
+  } else if (severities.size() == 2) {
+    int first = readSeverity(severities[0], owner);
+    int second = readSeverity(severities[1], owner);
+    rule.min_severity = std::min(first, second);
+    rule.max_severity = std::max(first, second);
+  } else if (!severities.empty()) {
+    throw std::runtime_error("A severity takes one name or a range of two in " + owner);
+  }
+}
+
+}
+
 Config::Config(const std::string &configPath) {
   loadConfig(configPath);
 }
@@ -17,6 +78,104 @@ void Config::loadConfig(const std::string &path) {
   output_to_screen_ = configJson["screen_output"];
   syslog_file_max_size_kb_ = configJson["file_max_size_kb"];
   syslog_max_memory_size_kb_ = configJson["max_memory_size_kb"];
+  reactor_threads_ = configJson.value("reactor_threads", reactor_threads_);
+  io_uring_ = configJson.value("io_uring", io_uring_);
+  listeners_ = configJson.value("listeners", listeners_);
+  if (listeners_ <= 0) {
+    listeners_ = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  }
+  cpu_steering_ = configJson.value("cpu_steering", cpu_steering_);
+  listen_backlog_ = configJson.value("listen_backlog", listen_backlog_);
+  stats_interval_sec_ = configJson.value("stats_interval_sec", stats_interval_sec_);
+  // unknown framing names keep auto detection
+  auto framing = framingModes.find(configJson.value("framing", std::string("auto")));
+  if (framing != framingModes.end()) {
+    framing_ = framing->second;
+  }
+  if (configJson.contains("file_overflow_policy")) {
+    file_overflow_policy_ = readOverflowPolicy(configJson["file_overflow_policy"], file_overflow_policy_);
+  }
+  if (configJson.contains("screen_overflow_policy")) {
+    screen_overflow_policy_ = readOverflowPolicy(configJson["screen_overflow_policy"], screen_overflow_policy_);
+  }
+  spill_directory_ = configJson.value("spill_directory", spill_directory_);
+  // by default the memory budget is split 1/4, 1/4, 1/2, so the lanes together keep to it
+  severity_lanes_ = {SeverityLaneConfig{8, syslog_max_memory_size_kb_ / 4},
+                     SeverityLaneConfig{4, syslog_max_memory_size_kb_ / 4},
+                     SeverityLaneConfig{1, syslog_max_memory_size_kb_ / 2}};
+  auto lanes = configJson.value("severity_lanes", json::object());
+  for (size_t i = 0; i < laneNames.size(); ++i) {
+    if (lanes.contains(laneNames[i])) {
+      auto lane = lanes[laneNames[i]];
+      severity_lanes_[i].weight = std::max(1u, lane.value("weight", severity_lanes_[i].weight));
+      severity_lanes_[i].memory_kb = lane.value("memory_kb", severity_lanes_[i].memory_kb);
+    }
+  }
+  auto rate_limit = configJson.value("client_rate_limit", json::object());
+  client_rate_limit_.messages_per_sec = rate_limit.value("messages_per_sec", client_rate_limit_.messages_per_sec);
+  client_rate_limit_.burst = rate_limit.value("burst", client_rate_limit_.burst);
+  if (rate_limit.value("action", std::string("throttle")) == "drop") {
+    client_rate_limit_.action = RateLimitAction::Drop;
+  }
+  fair_quantum_kb_ = std::max(1ul, configJson.value("fair_quantum_kb", fair_quantum_kb_));
+  auto durability = configJson.value("file_durability", json::object());
+  // unknown policy names keep the default
+  auto durability_policy = durabilityPolicies.find(durability.value("policy", std::string("none")));
+  if (durability_policy != durabilityPolicies.end()) {
+    file_durability_.policy = durability_policy->second;
+  }
+  file_durability_.interval_ms = std::max(1u, durability.value("interval_ms", file_durability_.interval_ms));
+  file_durability_.bytes = durability.value("bytes", file_durability_.bytes);
+  file_preallocate_ = configJson.value("file_preallocate", file_preallocate_);
+  file_direct_io_ = configJson.value("file_direct_io", file_direct_io_);
+  // size limits apply in any case, unknown names rotate on size only
+  auto rotation = rotationPeriods.find(configJson.value("file_rotation", std::string("size")));
+  if (rotation != rotationPeriods.end()) {
+    file_rotation_.period = rotation->second;
+  }
+  file_rotation_.compress = configJson.value("file_compression", file_rotation_.compress);
+  file_rotation_.compression_threads = configJson.value("compression_threads", file_rotation_.compression_threads);
+  auto retention = configJson.value("file_retention", json::object());
+  file_rotation_.max_total_bytes = retention.value("max_total_mb", uint64_t(0)) * 1024 * 1024;
+  file_rotation_.max_age_hours = retention.value("max_age_hours", file_rotation_.max_age_hours);
+  for (const auto &entry : configJson.value("file_routes", json::array())) {
+    RouteConfig route;
+    route.host = entry.value("host", route.host);
+    route.client_ip = entry.value("client_ip", route.client_ip);
+    route.path = entry.value("path", route.path);
+    const std::string owner = "route " + std::to_string(file_routes_.size() + 1);
+    std::string facility = entry.value("facility", std::string());
+    std::string severity = entry.value("severity", std::string());
+    route.facility = facility.empty() ? -1 : readFacility(facility, owner);
+    route.max_severity = severity.empty() ? 7 : readSeverity(severity, owner);
+    if (route.path.empty())
+      throw std::runtime_error("No path in " + owner);
+    file_routes_.push_back(std::move(route));
+  }
+  route_open_files_ = std::max(1ul, configJson.value("route_open_files", route_open_files_));
+  file_template_ = configJson.value("file_template", file_template_);
+  for (const auto &entry : configJson.value("rules", json::array())) {
+    RuleConfig rule;
+    rule.name = entry.value("name", "rule" + std::to_string(rules_.size() + 1));
+    std::string action_name = entry.value("action", std::string());
+    auto action = ruleActions.find(action_name);
+    if (action == ruleActions.end())
+      throw std::runtime_error("Unknown action \"" + action_name + "\" in rule " + rule.name);
+    readRuleMatch(entry.value("match", json::object()), rule);
+    rule.action = action->second;
+    if (rule.action == RuleAction::Route) {
+      RouteConfig route;
+      route.path = entry.value("path", std::string());
+      route.rule_only = true;
+      if (route.path.empty())
+        throw std::runtime_error("No path in rule " + rule.name);
+      rule.route = static_cast<int>(file_routes_.size());
+      file_routes_.push_back(std::move(route));
+    } else if (rule.action == RuleAction::Rewrite) {
+      rule.severity = readSeverity(entry.value("set_severity", std::string()), "rule " + rule.name);
+    }
+    rules_.push_back(std::move(rule));
+  }
   auto colors = configJson["priority_colors"];
   for (const auto &elt : levels) {
     // set default then check config.json
@@ -29,12 +188,67 @@ void Config::loadConfig(const std::string &path) {
       }
     }
   }
+  // error, info and debug lines are colored, the others printed in the default color
+  severity_colors_.fill(getAnsiColorCode(-1));
+  severity_colors_[3] = getAnsiColorCode(priorityColors.at("error"));
+  severity_colors_[6] = getAnsiColorCode(priorityColors.at("info"));
+  severity_colors_[7] = getAnsiColorCode(priorityColors.at("debug"));
+}
+
+const std::array<std::string, 8> &Config::getSeverityColors() const {
+  return severity_colors_;
+}
+
+std::string Config::getAnsiColorCode(int colorCode) {
+  switch (colorCode) {
+    case 0: return "\x1b[30m"; // Black
+    case 1: return "\x1b[34m"; // Blue
+    case 2: return "\x1b[32m"; // Green
+    case 3: return "\x1b[36m"; // Cyan
+    case 4: return "\x1b[31m"; // Red
+    case 5: return "\x1b[35m"; // Magenta
+    case 6: return "\x1b[33m"; // Yellow
+    case 7: return "\x1b[37m"; // White
+    case 8: return "\x1b[90m"; // Bright Black (Gray)
+    case 9: return "\x1b[94m"; // Bright Blue
+    case 10: return "\x1b[92m"; // Bright Green
+    case 11: return "\x1b[96m"; // Bright Cyan
+    case 12: return "\x1b[91m"; // Bright Red
+    case 13: return "\x1b[95m"; // Bright Magenta
+    case 14: return "\x1b[93m"; // Bright Yellow
+    case 15: return "\x1b[97m"; // Bright White
+    default: return "\x1b[0m"; // Reset
+  }
 }
 
 unsigned long Config::getMaxMemorySizeKb() const {
   return syslog_max_memory_size_kb_;
 }
 
+int Config::getReactorThreads() const {
+  return reactor_threads_;
+}
+
+bool Config::isIoUringEnabled() const {
+  return io_uring_;
+}
+
+int Config::getListeners() const {
+  return listeners_;
+}
+
+bool Config::isCpuSteeringEnabled() const {
+  return cpu_steering_;
+}
+
+int Config::getListenBacklog() const {
+  return listen_backlog_;
+}
+
+unsigned Config::getStatsIntervalSec() const {
+  return stats_interval_sec_;
+}
+
 int Config::getServerPort() const {
   return server_port_;
 }
@@ -58,3 +272,69 @@ unsigned long Config::getFileMaxSizeKb() const {
 bool Config::isOutputToScreen() const {
   return output_to_screen_;
 }
+
+SyslogFramer::Mode Config::getFraming() const {
+  return framing_;
+}
+
+OverflowPolicy Config::getFileOverflowPolicy() const {
+  return file_overflow_policy_;
+}
+
+OverflowPolicy Config::getScreenOverflowPolicy() const {
+  return screen_overflow_policy_;
+}
+
+const std::string &Config::getSpillDirectory() const {
+  return spill_directory_;
+}
+
+const std::array<SeverityLaneConfig, 3> &Config::getSeverityLanes() const {
+  return severity_lanes_;
+}
+
+const ClientRateLimitConfig &Config::getClientRateLimit() const {
+  return client_rate_limit_;
+}
+
+unsigned long Config::getFairQuantumKb() const {
+  return fair_quantum_kb_;
+}
+
+const DurabilityConfig &Config::getFileDurability() const {
+  return file_durability_;
+}
+
+bool Config::isFilePreallocated() const {
+  return file_preallocate_;
+}
+
+bool Config::isFileDirectIo() const {
+  return file_direct_io_;
+}
+
+const RotationConfig &Config::getFileRotation() const {
+  return file_rotation_;
+}
+
+const std::vector<RouteConfig> &Config::getFileRoutes() const {
+  return file_routes_;
+}
+
+unsigned long Config::getRouteOpenFiles() const {
+  return route_open_files_;
+}
+
+const std::string &Config::getFileTemplate() const {
+  return file_template_;
+}
+
+const std::vector<RuleConfig> &Config::getRules() const {
+  return rules_;
+}
+
+OverflowPolicy Config::readOverflowPolicy(const std::string &name, OverflowPolicy fallback) const {
+  // unknown policy names keep the default
+  auto policy = overflowPolicies.find(name);
+  return policy != overflowPolicies.end() ? policy->second : fallback;
+}
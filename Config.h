@@ -4,6 +4,21 @@
 #include <unordered_map>
 #include <string>
 #include <array>
+#include <vector>
+
+#include "ClientRateLimiter.h"
+#include "DurabilityPolicy.h"
+#include "LogArchiver.h"
+#include "LogRouter.h"
+#include "OverflowPolicy.h"
+#include "RuleEngine.h"
+#include "SyslogFramer.h"
+
+// Share of the sink queues given to one group of severities, see SeverityQueue
+struct SeverityLaneConfig {
+  unsigned weight;
+  unsigned long memory_kb;
+};
 
 class Config {
  public:
@@ -12,19 +27,93 @@ class Config {
   int getErrorSeverityColorCode() const;
   int getInfoSeverityColorCode() const;
   int getDebugSeverityColorCode() const;
+  // ANSI color sequence starting the screen lines of each severity
+  const std::array<std::string, 8> &getSeverityColors() const;
   unsigned long getFileMaxSizeKb() const;
   bool isOutputToScreen() const;
   unsigned long getMaxMemorySizeKb() const;
+  int getReactorThreads() const;
+  bool isIoUringEnabled() const;
+  int getListeners() const;
+  bool isCpuSteeringEnabled() const;
+  int getListenBacklog() const;
+  unsigned getStatsIntervalSec() const;
+  SyslogFramer::Mode getFraming() const;
+  OverflowPolicy getFileOverflowPolicy() const;
+  OverflowPolicy getScreenOverflowPolicy() const;
+  const std::string &getSpillDirectory() const;
+  // urgent (emergency..error), normal (warning, notice) and low (info, debug) lanes
+  const std::array<SeverityLaneConfig, 3> &getSeverityLanes() const;
+  const ClientRateLimitConfig &getClientRateLimit() const;
+  unsigned long getFairQuantumKb() const;
+  const DurabilityConfig &getFileDurability() const;
+  bool isFilePreallocated() const;
+  bool isFileDirectIo() const;
+  const RotationConfig &getFileRotation() const;
+  const std::vector<RouteConfig> &getFileRoutes() const;
+  unsigned long getRouteOpenFiles() const;
+  const std::vector<RuleConfig> &getRules() const;
+  // preset name or template, see OutputTemplate
+  const std::string &getFileTemplate() const;
 
  private:
   int server_port_ = 60119;
   bool output_to_screen_ = false;
   unsigned long syslog_file_max_size_kb_ = 1000; // 1MB
   unsigned long syslog_max_memory_size_kb_ = 1000000; // 1GB
+  int reactor_threads_ = 0; // 0: one thread per client
+  bool io_uring_ = false;
+  int listeners_ = 1; // SO_REUSEPORT sockets, 0: one per core
+  bool cpu_steering_ = false;
+  int listen_backlog_ = 4096; // capped by net.core.somaxconn
+  unsigned stats_interval_sec_ = 0; // 0: no periodic stats
+  SyslogFramer::Mode framing_ = SyslogFramer::Mode::Auto;
+  OverflowPolicy file_overflow_policy_ = OverflowPolicy::Block;
+  OverflowPolicy screen_overflow_policy_ = OverflowPolicy::Block;
+  std::string spill_directory_ = "spill";
+  std::array<SeverityLaneConfig, 3> severity_lanes_{};
+  ClientRateLimitConfig client_rate_limit_{0, 1000, RateLimitAction::Throttle};
+  unsigned long fair_quantum_kb_ = 256; // bytes a reactor reads from a client per round
+  DurabilityConfig file_durability_{DurabilityPolicy::None, 100, 1024 * 1024};
+  bool file_preallocate_ = false;
+  bool file_direct_io_ = false;
+  RotationConfig file_rotation_{RotationPeriod::None, false, 1, 0, 0};
+  std::vector<RouteConfig> file_routes_; // empty: everything goes to the main log
+  unsigned long route_open_files_ = 256; // LRU of descriptors of routed files
+  std::vector<RuleConfig> rules_;
+  std::string file_template_ = "raw";
   std::unordered_map<std::string, int> priorityColors;
+  std::array<std::string, 8> severity_colors_;
   void loadConfig(const std::string &path);
   const std::array<std::string, 3> levels = {"error", "info", "debug"};
+  const std::array<std::string, 3> laneNames = {"urgent", "normal", "low"};
   const std::unordered_map<std::string, int> defaultColors = {{"error", 12}, {"info", 1}, {"debug", 8}};
+  const std::unordered_map<std::string, SyslogFramer::Mode> framingModes = {
+      {"auto", SyslogFramer::Mode::Auto},
+      {"octet_counting", SyslogFramer::Mode::OctetCounting},
+      {"non_transparent", SyslogFramer::Mode::NonTransparent}};
+  const std::unordered_map<std::string, OverflowPolicy> overflowPolicies = {
+      {"block", OverflowPolicy::Block},
+      {"drop_newest", OverflowPolicy::DropNewest},
+      {"drop_oldest", OverflowPolicy::DropOldest},
+      {"drop_by_severity", OverflowPolicy::DropBySeverity},
+      {"spill", OverflowPolicy::Spill}};
+  const std::unordered_map<std::string, DurabilityPolicy> durabilityPolicies = {
+      {"none", DurabilityPolicy::None},
+      {"interval", DurabilityPolicy::Interval},
+      {"bytes", DurabilityPolicy::Bytes},
+      {"batch", DurabilityPolicy::Batch}};
+  const std::unordered_map<std::string, RotationPeriod> rotationPeriods = {
+      {"size", RotationPeriod::None},
+      {"hourly", RotationPeriod::Hourly},
+      {"daily", RotationPeriod::Daily}};
+  const std::unordered_map<std::string, RuleAction> ruleActions = {
+      {"keep", RuleAction::Keep},
+      {"drop", RuleAction::Drop},
+      {"route", RuleAction::Route},
+      {"rewrite", RuleAction::Rewrite}};
+  OverflowPolicy readOverflowPolicy(const std::string &name, OverflowPolicy fallback) const;
+  static std::string getAnsiColorCode(int colorCode);
   const std::unordered_map<std::string, int> winTerminalColors = {
       {"BLACK", 0},
       {"BLUE", 1},
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * When the file logger forces written log lines to disk (fdatasync).
+ *  - None: never, the kernel writes them back on its own schedule
+ *  - Interval: every interval_ms, if anything was written since the last sync
+ *  - Bytes: whenever bytes have been written since the last sync
+ *  - Batch: after every batch (group commit), nothing acknowledged by a write is lost
+ */
+enum class DurabilityPolicy { None, Interval, Bytes, Batch };
+
+struct DurabilityConfig {
+  DurabilityPolicy policy;
+  unsigned interval_ms;
+  uint64_t bytes;
+};
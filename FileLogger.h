@@ -1,27 +1,95 @@
 #pragma once
 
-#include <fstream>
 #include <atomic>
+#include <iostream>
 #include <thread>
 #include <mutex>
 #include <utility>
-#include <filesystem>
+#include <vector>
 #include <sstream>
+#include <iomanip>
+#include <filesystem>
 
-#include "MemoryBoundedQueue.h"
+#include "DurabilityPolicy.h"
+#include "LogArchiver.h"
+#include "LogFile.h"
+#include "LogRecord.h"
+#include "LogRouter.h"
+#include "OutputTemplate.h"
+#include "SeverityQueue.h"
+#include "Metrics.h"
 
+/*
+ * Writes the file queue to log files rotated by size and optionally on the hour or day,
+ * handing closed ones to a LogArchiver. Records matching a route go to their own files
+ * instead (see LogRouter). Lines are the frames as received, or formatted by an
+ * OutputTemplate. Every batch goes out with one writev(), or into the 1 MB buffer of a
+ * preallocated segment (see LogFile), and is then synced as the DurabilityPolicy says; under
+ * Interval a background thread does the syncing, and the mutex keeps it away from a file
+ * being rotated.
+ */
 class FileLogger {
  private:
-  MemoryBoundedQueue<std::string> &queue_;
-  std::ofstream file_stream_;
+  SeverityQueue &queue_;
+  LogFile log_file_;
   std::atomic<bool> running_ = true;
   std::atomic<bool> wait_ = false;
   std::thread worker_;
   std::mutex mtx_;
   std::string filename_;
-  const std::chrono::milliseconds flush_interval_ = std::chrono::milliseconds(100);
   const unsigned long max_file_size_;
-  bool stopWorker = false;
+  const DurabilityConfig durability_;
+  const RotationPeriod rotation_period_;
+  std::chrono::system_clock::time_point next_rotation_ = std::chrono::system_clock::time_point::max();
+  LogArchiver archiver_;
+  LogRouter router_;
+  OutputTemplate template_;
+  // size of the current file, counted as we write instead of asking the file system
+  uint64_t file_offset_ = 0;
+  uint64_t unsynced_bytes_ = 0;
+  // a batch is written with one writev() and followed by one rotation check
+  static constexpr size_t kBatchItems = 1024;
+  static constexpr size_t kBatchBytes = 64 * 1024;
+  std::vector<LogRecord> batch_;
+  std::vector<std::string_view> lines_;
+  // formatted lines of the batch unless the template is raw, the lines end at line_ends_
+  std::string formatted_;
+  std::vector<size_t> line_ends_;
+  std::atomic<bool> stopWorker = false;
+  // delay between generating the last timestamped message and writing it
+  std::atomic<uint64_t> event_lag_ms_ = 0;
+  // cumulative, so the stats show throughput and mean latency of the durability policy
+  std::atomic<uint64_t> &writes_;
+  std::atomic<uint64_t> &write_us_;
+  std::atomic<uint64_t> &written_bytes_;
+  std::atomic<uint64_t> &syncs_;
+  std::atomic<uint64_t> &sync_us_;
+
+  static uint64_t elapsedUs(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+  }
+
+  // Start of the next hour or day in local time
+  static std::chrono::system_clock::time_point nextBoundary(RotationPeriod period) {
+    auto now_c = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    struct tm boundary{};
+#ifdef _WIN32
+    localtime_s(&boundary, &now_c);
+#else
+    localtime_r(&now_c, &boundary);
+#endif
+    boundary.tm_sec = 0;
+    boundary.tm_min = 0;
+    if (period == RotationPeriod::Daily) {
+      boundary.tm_hour = 0;
+      boundary.tm_mday += 1;
+    } else {
+      boundary.tm_hour += 1;
+    }
+    boundary.tm_isdst = -1; // mktime normalizes the overflow and works out DST
+    return std::chrono::system_clock::from_time_t(mktime(&boundary));
+  }
 
   // Generate a filename based on the current date and time
   static std::string getFormattedFilename() {
@@ -31,7 +99,11 @@ class FileLogger {
     auto now_c = std::chrono::system_clock::to_time_t(now);
     // Convert to tm struct for use with put_time
     struct tm now_tm{};
+#ifdef _WIN32
     localtime_s(&now_tm, &now_c);
+#else
+    localtime_r(&now_c, &now_tm);
+#endif
 
     // Use ostringstream to format filename
     std::ostringstream oss;
@@ -40,64 +112,192 @@ class FileLogger {
     return oss.str();
   }
 
+  // Opens filename_ for appending, the only place the file size is read from disk
+  void openLogFile() {
+    if (!log_file_.open(filename_)) {
+      std::cerr << "Unable to open log file " << filename_ << std::endl;
+    }
+    file_offset_ = log_file_.size();
+    archiver_.setActiveFile(filename_);
+    if (rotation_period_ != RotationPeriod::None) {
+      next_rotation_ = nextBoundary(rotation_period_);
+    }
+  }
+
   // Open a new log file with the current timestamp
   void openNewLogFile() {
-    if (file_stream_.is_open()) {
-      file_stream_.close();
+    if (durability_.policy != DurabilityPolicy::None) {
+      syncFile();
     }
+    log_file_.close();
+    std::string closed = filename_;
+    // a second rotation within the same second must not append to the closed file
     filename_ = getFormattedFilename();
-    file_stream_.open(filename_, std::ios::app);
+    std::string base = filename_.substr(0, filename_.size() - 4);
+    std::error_code error;
+    for (int n = 1; filename_ == closed || std::filesystem::exists(filename_, error); ++n) {
+      filename_ = base + "_" + std::to_string(n) + ".txt";
+    }
+    openLogFile();
+    archiver_.submit(closed);
   }
 
-  // Check the size of the current log file and rotate if necessary
+  // Rotate once the current log file reached its maximum size
   void checkAndRotateFile() {
-    if (std::filesystem::file_size(filename_) >= max_file_size_) {
+    if (file_offset_ >= max_file_size_) {
+      openNewLogFile();
+    }
+  }
+
+  // Caller holds mtx_
+  void syncFile() {
+    if (unsynced_bytes_ == 0)
+      return;
+    auto start = std::chrono::steady_clock::now();
+    if (!log_file_.sync()) {
+      std::cerr << "Unable to sync log file " << filename_ << std::endl;
+    }
+    router_.sync();
+    sync_us_ += elapsedUs(start);
+    ++syncs_;
+    unsynced_bytes_ = 0;
+  }
+
+  // Waits for pending records and writes up to one batch of them
+  void writeBatch() {
+    batch_.clear();
+    lines_.clear();
+    queue_.drainInto(batch_, kBatchItems, kBatchBytes);
+    if (batch_.empty())
+      return;
+    int64_t last_timestamp_ns = -1;
+    uint64_t bytes = 0;
+    if (!template_.isRaw()) {
+      // all lines first, growing the buffer would move the ones already handed out
+      formatted_.clear();
+      line_ends_.clear();
+      for (const LogRecord &record : batch_) {
+        template_.format(record, formatted_);
+        line_ends_.push_back(formatted_.size());
+      }
+    }
+    for (size_t i = 0; i < batch_.size(); ++i) {
+      const LogRecord &record = batch_[i];
+      if (record.timestamp_ns >= 0)
+        last_timestamp_ns = record.timestamp_ns;
+      std::string_view line = record.frame.line();
+      if (!template_.isRaw()) {
+        size_t begin = i > 0 ? line_ends_[i - 1] : 0;
+        line = std::string_view(formatted_).substr(begin, line_ends_[i] - begin);
+      }
+      if (router_.isEnabled() && router_.route(record, line))
+        continue;
+      lines_.push_back(line);
+      bytes += line.size();
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    // lines received after the boundary go to the new file
+    if (std::chrono::system_clock::now() >= next_rotation_) {
       openNewLogFile();
     }
+    auto start = std::chrono::steady_clock::now();
+    if (!lines_.empty() && !log_file_.write(lines_.data(), lines_.size())) {
+      std::cerr << "Unable to write log file " << filename_ << std::endl;
+    }
+    file_offset_ += bytes;
+    if (router_.isEnabled()) {
+      bytes += router_.flush();
+    }
+    written_bytes_ += bytes;
+    unsynced_bytes_ += bytes;
+    if (durability_.policy == DurabilityPolicy::Batch
+        || (durability_.policy == DurabilityPolicy::Bytes && unsynced_bytes_ >= durability_.bytes)) {
+      syncFile();
+    } else if (queue_.empty() && !log_file_.flush()) {
+      // a segment buffer is not kept back from readers while nothing else arrives
+      std::cerr << "Unable to write log file " << filename_ << std::endl;
+    }
+    write_us_ += elapsedUs(start);
+    ++writes_;
+    checkAndRotateFile();
+    if (last_timestamp_ns >= 0) {
+      auto now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count();
+      // clocks of senders may be ahead
+      event_lag_ms_ = now_ns > last_timestamp_ns ? static_cast<uint64_t>(now_ns - last_timestamp_ns) / 1000000 : 0;
+    }
   }
 
-  void backgroundScreenFlush() {
+  // Interval policy only
+  void backgroundSync() {
+    const auto interval = std::chrono::milliseconds(durability_.interval_ms);
     while (!stopWorker) {
-      std::this_thread::sleep_for(flush_interval_);
+      std::this_thread::sleep_for(interval);
       std::lock_guard<std::mutex> lock(mtx_);
-      file_stream_.flush();
+      syncFile();
     }
   }
 
  public:
-  FileLogger(MemoryBoundedQueue<std::string> &q, unsigned long file_size)
-      : filename_(std::move(getFormattedFilename())),
+  FileLogger(SeverityQueue &q,
+             unsigned long file_size,
+             const DurabilityConfig &durability,
+             const LogFileOptions &file_options,
+             const RotationConfig &rotation,
+             const std::vector<RouteConfig> &routes,
+             unsigned long route_open_files,
+             const std::string &line_template)
+      : queue_(q),
+        log_file_(file_options),
+        filename_(getFormattedFilename()),
         max_file_size_(file_size),
-        queue_(q) {
-    worker_ = std::thread(&::FileLogger::backgroundScreenFlush, this);
+        durability_(durability),
+        rotation_period_(rotation.period),
+        archiver_(rotation, "syslog_"),
+        router_(routes, route_open_files, durability.policy != DurabilityPolicy::None),
+        template_(line_template),
+        writes_(Metrics::instance().counter("file.writes")),
+        write_us_(Metrics::instance().counter("file.write_us")),
+        written_bytes_(Metrics::instance().counter("file.bytes")),
+        syncs_(Metrics::instance().counter("file.syncs")),
+        sync_us_(Metrics::instance().counter("file.sync_us")) {
+    if (durability_.policy == DurabilityPolicy::Interval) {
+      worker_ = std::thread(&::FileLogger::backgroundSync, this);
+    }
+    Metrics::instance().gauge("file.event_lag_ms", [this]() -> uint64_t { return event_lag_ms_; });
+    Metrics::instance().gauge("file.physical_bytes", [this]() -> uint64_t { return log_file_.physicalBytes(); });
+    // bytes handed to the kernel per 100 bytes of log lines, above 100 with padded direct I/O blocks
+    Metrics::instance().gauge("file.write_amplification_pct", [this]() -> uint64_t {
+      uint64_t bytes = written_bytes_;
+      return bytes > 0 ? log_file_.physicalBytes() * 100 / bytes : 100;
+    });
+  }
+
+  // Whether lines need the client IP of their records
+  bool needsClientIp() const {
+    return template_.usesClientIp();
   }
 
   ~FileLogger() {
     stopWorker = true;
-    worker_.join();
-    if (file_stream_.is_open()) {
-      file_stream_.close();
+    if (worker_.joinable()) {
+      worker_.join();
     }
   }
 
   void run() {
-    file_stream_.open(filename_, std::ios::app);
-    unsigned int count = 0;
+    openLogFile();
     while (running_) {
-      std::string log = queue_.pop();
-      std::lock_guard<std::mutex> lock(mtx_);
-      file_stream_ << log;
-      checkAndRotateFile();
+      writeBatch();
     }
-    file_stream_.flush(); // in case wait_ is used and takes time
     if (wait_) {
       while (!queue_.empty()) {
-        std::string log = queue_.pop();
-        std::lock_guard<std::mutex> lock(mtx_);
-        file_stream_ << log;
-        checkAndRotateFile();
+        writeBatch();
       }
-      file_stream_.flush();
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (durability_.policy != DurabilityPolicy::None) {
+      syncFile();
     }
   }
 
@@ -0,0 +1,147 @@
+#include "FrameRef.h"
+
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "Metrics.h"
+
+namespace {
+
+constexpr size_t kSlabSize = 256 * 1024;
+// larger frames get their own allocation instead of wasting the rest of a slab
+constexpr size_t kMaxSlabFrame = kSlabSize / 8;
+// beyond this many idle slabs, released slabs go back to the system
+constexpr size_t kMaxFreeSlabs = 64;
+
+}
+
+// Slab header, the frames follow it. The receiving thread holds one reference while it
+// carves from the slab, every frame carved holds another.
+struct alignas(std::max_align_t) FrameSlab {
+  std::atomic<uint32_t> references{1};
+  size_t used = 0;
+
+  char *data() { return reinterpret_cast<char *>(this + 1); }
+};
+
+namespace {
+
+class SlabPool {
+ public:
+  static SlabPool &instance() {
+    // never destroyed, threads may still release frames during exit
+    static auto *pool = new SlabPool();
+    return *pool;
+  }
+
+  FrameSlab *acquire() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_.empty()) {
+        FrameSlab *slab = free_.back();
+        free_.pop_back();
+        ++in_use_;
+        return slab;
+      }
+      ++in_use_;
+    }
+    ++slab_allocations_;
+    return new(::operator new(sizeof(FrameSlab) + kSlabSize)) FrameSlab();
+  }
+
+  void recycle(FrameSlab *slab) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --in_use_;
+      if (free_.size() < kMaxFreeSlabs) {
+        slab->references.store(1, std::memory_order_relaxed);
+        slab->used = 0;
+        free_.push_back(slab);
+        return;
+      }
+    }
+    slab->~FrameSlab();
+    ::operator delete(slab);
+  }
+
+  void countHeapFrame() {
+    ++heap_frames_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<FrameSlab *> free_;
+  uint64_t in_use_ = 0;
+  std::atomic<uint64_t> &heap_frames_;
+  std::atomic<uint64_t> &slab_allocations_;
+
+  SlabPool()
+      : heap_frames_(Metrics::instance().counter("arena.heap_frames")),
+        slab_allocations_(Metrics::instance().counter("arena.slab_allocations")) {
+    free_.reserve(kMaxFreeSlabs);
+    Metrics::instance().gauge("arena.slabs_in_use", [this]() -> uint64_t {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return in_use_;
+    });
+    Metrics::instance().gauge("arena.slabs_free", [this]() -> uint64_t {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return free_.size();
+    });
+  }
+};
+
+void releaseSlab(FrameSlab *slab) {
+  if (slab->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    SlabPool::instance().recycle(slab);
+}
+
+// slab the current thread carves from
+struct ThreadArena {
+  FrameSlab *slab = nullptr;
+
+  ~ThreadArena() {
+    if (slab != nullptr)
+      releaseSlab(slab);
+  }
+};
+
+thread_local ThreadArena arena;
+
+}
+
+FrameRef FrameRef::create(std::string_view frame) {
+  size_t size = blockSize(frame.size());
+  Block *block;
+  if (size > kMaxSlabFrame) {
+    SlabPool::instance().countHeapFrame();
+    block = new(::operator new(size)) Block();
+  } else {
+    if (arena.slab == nullptr || arena.slab->used + size > kSlabSize) {
+      if (arena.slab != nullptr)
+        releaseSlab(arena.slab);
+      arena.slab = SlabPool::instance().acquire();
+    }
+    FrameSlab *slab = arena.slab;
+    block = new(slab->data() + slab->used) Block();
+    block->slab = slab;
+    slab->used += size;
+    slab->references.fetch_add(1, std::memory_order_relaxed);
+  }
+  block->length = static_cast<uint32_t>(frame.size());
+  char *data = block->data();
+  std::memcpy(data, frame.data(), frame.size());
+  data[frame.size()] = '\n';
+  return FrameRef(block);
+}
+
+void FrameRef::release(Block *block) {
+  FrameSlab *slab = block->slab;
+  block->~Block();
+  if (slab != nullptr)
+    releaseSlab(slab);
+  else
+    ::operator delete(block);
+}
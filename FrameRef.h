@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+struct FrameSlab;
+
+/*
+ * Handle on an immutable, reference counted copy of one syslog frame followed by a
+ * newline. The frame is copied once when it leaves the connection; every sink queue gets
+ * a handle, so fanning out costs a reference count increment instead of a copy.
+ * Copies are carved out of large slabs owned by the receiving thread and recycled once
+ * all frames of a slab are released, so steady state ingestion does not hit malloc.
+ */
+class FrameRef {
+ public:
+  FrameRef() = default;
+
+  static FrameRef create(std::string_view frame);
+
+  FrameRef(const FrameRef &other) : block_(other.block_) {
+    if (block_ != nullptr)
+      block_->references.fetch_add(1, std::memory_order_relaxed);
+  }
+  FrameRef(FrameRef &&other) noexcept : block_(std::exchange(other.block_, nullptr)) {}
+  FrameRef &operator=(FrameRef other) noexcept {
+    std::swap(block_, other.block_);
+    return *this;
+  }
+  ~FrameRef() {
+    if (block_ != nullptr && block_->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      release(block_);
+  }
+
+  // The frame without the trailing newline, empty for a default constructed handle
+  std::string_view frame() const {
+    return block_ != nullptr ? std::string_view(block_->data(), block_->length) : std::string_view();
+  }
+  // The frame with the trailing newline, as written to log files
+  std::string_view line() const {
+    return block_ != nullptr ? std::string_view(block_->data(), block_->length + 1) : std::string_view();
+  }
+  // Bytes the shared copy occupies in its slab (or heap block), header and padding included
+  size_t memoryUsage() const {
+    return block_ != nullptr ? blockSize(block_->length) : 0;
+  }
+
+ private:
+  struct Block {
+    std::atomic<uint32_t> references{1};
+    uint32_t length = 0;
+    FrameSlab *slab = nullptr; // nullptr for frames too large for a slab
+
+    char *data() { return reinterpret_cast<char *>(this + 1); }
+  };
+
+  Block *block_ = nullptr;
+
+  explicit FrameRef(Block *block) : block_(block) {}
+  static size_t blockSize(size_t length) {
+    return (sizeof(Block) + length + 1 + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+  }
+  static void release(Block *block);
+};
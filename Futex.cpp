@@ -0,0 +1,60 @@
+#include "Futex.h"
+
+#if defined(__linux__)
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32 bit integer");
+
+#if defined(__linux__)
+
+void Futex::wait(uint32_t expected) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&value), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void Futex::wakeOne() {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&value), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+void Futex::wakeAll() {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&value), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#elif defined(_WIN32)
+
+void Futex::wait(uint32_t expected) {
+  WaitOnAddress(&value, &expected, sizeof(expected), INFINITE);
+}
+
+void Futex::wakeOne() {
+  WakeByAddressSingle(&value);
+}
+
+void Futex::wakeAll() {
+  WakeByAddressAll(&value);
+}
+
+#else
+
+void Futex::wait(uint32_t expected) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  condition_variable_.wait(lock, [this, expected] { return value.load() != expected; });
+}
+
+void Futex::wakeOne() {
+  // taking the lock orders the change of value before a concurrent wait()
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  condition_variable_.notify_one();
+}
+
+void Futex::wakeAll() {
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  condition_variable_.notify_all();
+}
+
+#endif
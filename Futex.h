@@ -0,0 +1,29 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#if !defined(__linux__) && !defined(_WIN32)
+#include <condition_variable>
+#include <mutex>
+#endif
+
+/*
+ * 32 bit word threads can sleep on until another thread changes it and wakes them:
+ * futex on Linux, WaitOnAddress on Windows, a condition variable elsewhere. Waking costs
+ * a syscall, so callers only wake when they know somebody sleeps.
+ */
+class Futex {
+ public:
+  std::atomic<uint32_t> value{0};
+
+  // Sleeps while value == expected, may also return spuriously
+  void wait(uint32_t expected);
+  void wakeOne();
+  void wakeAll();
+
+ private:
+#if !defined(__linux__) && !defined(_WIN32)
+  std::mutex mutex_;
+  std::condition_variable condition_variable_;
+#endif
+};
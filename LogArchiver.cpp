@@ -0,0 +1,189 @@
+#include "LogArchiver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#ifdef SYSLOG_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef __linux__
+#include <sys/resource.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+const std::chrono::minutes kRetentionInterval(1);
+}
+
+LogArchiver::LogArchiver(const RotationConfig &config, const std::string &prefix)
+    : config_(config), prefix_(prefix), compress_(config.compress) {
+#ifndef SYSLOG_HAVE_ZLIB
+  if (compress_) {
+    std::cerr << "Log compression needs zlib, which was not found at build time" << std::endl;
+    compress_ = false;
+  }
+#endif
+  if (!isEnabled())
+    return;
+  next_retention_ = std::chrono::steady_clock::now() + kRetentionInterval;
+  unsigned threads = std::max(1u, config_.compression_threads);
+  for (unsigned i = 0; i < threads; ++i) {
+    workers_.emplace_back(&LogArchiver::run, this);
+  }
+}
+
+LogArchiver::~LogArchiver() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  wakeup_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+bool LogArchiver::isEnabled() const {
+  return compress_ || config_.max_total_bytes > 0 || config_.max_age_hours > 0;
+}
+
+void LogArchiver::setActiveFile(const std::string &path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  active_file_ = path;
+}
+
+void LogArchiver::submit(const std::string &path) {
+  if (!isEnabled())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back(path);
+  }
+  wakeup_.notify_one();
+}
+
+void LogArchiver::run() {
+  // behind the writer and the client threads for the CPU
+#ifdef __linux__
+  setpriority(PRIO_PROCESS, 0, 19); // the calling thread only on Linux
+#elif defined(_WIN32)
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#endif
+  for (;;) {
+    std::string path;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      // the deadline is read again on every wakeup, another worker may have taken the timer
+      while (!stopped_ && pending_.empty() && std::chrono::steady_clock::now() < next_retention_)
+        wakeup_.wait_until(lock, next_retention_);
+      if (!pending_.empty()) {
+        path = std::move(pending_.front());
+        pending_.pop_front();
+        in_progress_.insert(path);
+      } else if (stopped_) {
+        return;
+      } else {
+        next_retention_ = std::chrono::steady_clock::now() + kRetentionInterval;
+      }
+    }
+    if (!path.empty()) {
+      if (compress_)
+        compress(path);
+      std::lock_guard<std::mutex> lock(mutex_);
+      in_progress_.erase(path);
+    }
+    enforceRetention();
+  }
+}
+
+bool LogArchiver::compress(const std::string &path) {
+#ifdef SYSLOG_HAVE_ZLIB
+  // written aside and renamed, so retention never sees half a file
+  const std::string target = path + ".gz";
+  const std::string partial = target + ".part";
+  std::ifstream input(path, std::ios::binary);
+  gzFile output = input ? gzopen(partial.c_str(), "wb6") : nullptr;
+  if (output == nullptr) {
+    std::cerr << "Unable to compress log file " << path << std::endl;
+    return false;
+  }
+  std::vector<char> buffer(256 * 1024);
+  bool ok = true;
+  while (ok && input) {
+    input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    auto length = static_cast<unsigned>(input.gcount());
+    if (length > 0 && gzwrite(output, buffer.data(), length) != static_cast<int>(length))
+      ok = false;
+  }
+  ok = gzclose(output) == Z_OK && ok && input.eof();
+  std::error_code error;
+  if (ok) {
+    fs::rename(partial, target, error);
+    ok = !error;
+  }
+  if (!ok) {
+    std::cerr << "Unable to compress log file " << path << std::endl;
+    fs::remove(partial, error);
+    return false;
+  }
+  fs::remove(path, error);
+  return true;
+#else
+  (void) path;
+  return false;
+#endif
+}
+
+void LogArchiver::enforceRetention() {
+  if (config_.max_total_bytes == 0 && config_.max_age_hours == 0)
+    return;
+  std::set<std::string> busy;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    busy = in_progress_;
+    busy.insert(pending_.begin(), pending_.end());
+    busy.insert(active_file_);
+  }
+  struct Rotated {
+    fs::path path;
+    uint64_t size;
+    fs::file_time_type modified;
+    std::string timestamp;
+    int sequence; // _<n> of files rotated within the same second
+  };
+  std::vector<Rotated> files;
+  std::error_code error;
+  for (const auto &entry : fs::directory_iterator(fs::current_path(), error)) {
+    std::string name = entry.path().filename().string();
+    bool log_file = name.compare(0, prefix_.size(), prefix_) == 0
+        && (entry.path().extension() == ".txt" || entry.path().extension() == ".gz");
+    if (!log_file || busy.count(name) != 0 || !entry.is_regular_file(error))
+      continue;
+    // <prefix>YYYY_MM_DD_HH_MM_SS[_<n>].txt[.gz]
+    size_t stamp = prefix_.size() + 19;
+    int sequence = name.size() > stamp && name[stamp] == '_' ? std::atoi(name.c_str() + stamp + 1) : 0;
+    files.push_back({entry.path(), entry.file_size(error), entry.last_write_time(error), name.substr(0, stamp), sequence});
+  }
+  // oldest first
+  std::sort(files.begin(), files.end(), [](const Rotated &a, const Rotated &b) {
+    return a.timestamp != b.timestamp ? a.timestamp < b.timestamp : a.sequence < b.sequence;
+  });
+  uint64_t total = 0;
+  for (const auto &file : files)
+    total += file.size;
+  auto oldest_allowed = fs::file_time_type::clock::now() - std::chrono::hours(config_.max_age_hours);
+  for (const auto &file : files) {
+    bool too_old = config_.max_age_hours > 0 && file.modified < oldest_allowed;
+    bool over_budget = config_.max_total_bytes > 0 && total > config_.max_total_bytes;
+    if (!too_old && !over_budget)
+      continue;
+    if (fs::remove(file.path, error))
+      total -= file.size;
+  }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Rotation besides the size limit, at local time boundaries
+enum class RotationPeriod { None, Hourly, Daily };
+
+struct RotationConfig {
+  RotationPeriod period;
+  bool compress;
+  unsigned compression_threads;
+  uint64_t max_total_bytes; // rotated files together, 0: unlimited
+  unsigned max_age_hours; // 0: unlimited
+};
+
+/*
+ * Housekeeping of rotated log files, off the write path: a few low priority threads gzip
+ * every submitted file (when built with zlib) and then apply the retention policy, deleting
+ * the oldest rotated files beyond the total size or age limit. Retention also runs once a
+ * minute, so files age out on a server that does not rotate. The file being written is
+ * never touched.
+ */
+class LogArchiver {
+ public:
+  LogArchiver(const RotationConfig &config, const std::string &prefix);
+  // Finishes the files already submitted
+  ~LogArchiver();
+  LogArchiver(const LogArchiver &) = delete;
+  LogArchiver &operator=(const LogArchiver &) = delete;
+
+  // False when there is nothing to do with rotated files
+  bool isEnabled() const;
+  // The file now being written, excluded from retention
+  void setActiveFile(const std::string &path);
+  // Hands over a closed log file
+  void submit(const std::string &path);
+
+ private:
+  const RotationConfig config_;
+  const std::string prefix_;
+  bool compress_;
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::deque<std::string> pending_;
+  // being compressed, left alone by retention like the pending ones
+  std::set<std::string> in_progress_;
+  std::string active_file_;
+  std::chrono::steady_clock::time_point next_retention_;
+  bool stopped_ = false;
+  std::vector<std::thread> workers_;
+
+  void run();
+  bool compress(const std::string &path);
+  void enforceRetention();
+};
@@ -0,0 +1,300 @@
+#include "LogFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// UIO_MAXIOV on Linux, the smallest IOV_MAX in practice
+const size_t kMaxIovecs = 1024;
+const size_t kSegmentBuffer = 1024 * 1024;
+// O_DIRECT offsets and lengths must be multiples of the logical block size, 4 KB covers all
+const size_t kDirectAlignment = 4096;
+}
+
+void LogFile::AlignedDeleter::operator()(char *buffer) const {
+  std::free(buffer);
+}
+
+LogFile::LogFile(const LogFileOptions &options) : options_(options) {
+#ifdef __linux__
+  segment_mode_ = options_.preallocate_bytes > 0 || options_.direct_io;
+  if (segment_mode_) {
+    void *buffer = nullptr;
+    if (posix_memalign(&buffer, kDirectAlignment, kSegmentBuffer) != 0)
+      throw std::bad_alloc();
+    buffer_.reset(static_cast<char *>(buffer));
+  }
+#else
+  segment_mode_ = false;
+  if (options_.preallocate_bytes > 0 || options_.direct_io)
+    std::cerr << "Log file preallocation and direct I/O need Linux, ignored" << std::endl;
+#endif
+}
+
+LogFile::~LogFile() {
+  close();
+}
+
+bool LogFile::isOpen() const {
+  return fd_ >= 0;
+}
+
+uint64_t LogFile::size() const {
+  return size_;
+}
+
+uint64_t LogFile::physicalBytes() const {
+  return physical_bytes_.load(std::memory_order_relaxed);
+}
+
+#ifdef _WIN32
+
+bool LogFile::open(const std::string &path) {
+  close();
+  fd_ = _open(path.c_str(), _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+  if (fd_ < 0)
+    return false;
+  struct _stat64 st{};
+  size_ = _fstat64(fd_, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+  return true;
+}
+
+void LogFile::close() {
+  if (fd_ < 0)
+    return;
+  _close(fd_);
+  fd_ = -1;
+}
+
+bool LogFile::write(const std::string_view *buffers, size_t count) {
+  if (fd_ < 0)
+    return false;
+  for (size_t i = 0; i < count; ++i) {
+    const char *data = buffers[i].data();
+    size_t left = buffers[i].size();
+    while (left > 0) {
+      int written = _write(fd_, data, static_cast<unsigned>(std::min<size_t>(left, 1u << 30)));
+      if (written < 0)
+        return false;
+      data += written;
+      left -= static_cast<size_t>(written);
+      size_ += static_cast<uint64_t>(written);
+      physical_bytes_ += static_cast<uint64_t>(written);
+    }
+  }
+  return true;
+}
+
+bool LogFile::flush() {
+  return fd_ >= 0;
+}
+
+bool LogFile::sync() {
+  return fd_ >= 0 && _commit(fd_) == 0;
+}
+
+bool LogFile::writeAt(const char *, size_t, uint64_t) {
+  return false;
+}
+
+bool LogFile::openSegment(const std::string &) {
+  return false;
+}
+
+#else
+
+bool LogFile::open(const std::string &path) {
+  close();
+  if (segment_mode_)
+    return openSegment(path);
+  fd_ = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0)
+    return false;
+  struct stat st{};
+  size_ = fstat(fd_, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+  return true;
+}
+
+bool LogFile::openSegment(const std::string &path) {
+#ifdef __linux__
+  direct_io_ = options_.direct_io;
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (direct_io_ ? O_DIRECT : 0), 0644);
+  if (fd_ < 0 && direct_io_ && errno == EINVAL) {
+    std::cerr << "Direct I/O is not supported for " << path << ", writing through the page cache" << std::endl;
+    direct_io_ = false;
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  }
+  if (fd_ < 0)
+    return false;
+  struct stat st{};
+  size_ = fstat(fd_, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+  buffer_offset_ = size_;
+  buffer_length_ = 0;
+  int reader = size_ > 0 ? ::open(path.c_str(), O_RDONLY | O_CLOEXEC) : -1;
+  if (reader >= 0) {
+    // a crash under O_DIRECT leaves the zero padding of the last block, lines never end in NUL
+    uint64_t tail = std::min<uint64_t>(size_, kDirectAlignment);
+    if (pread(reader, buffer_.get(), tail, static_cast<off_t>(size_ - tail)) == static_cast<ssize_t>(tail)) {
+      while (tail > 0 && buffer_.get()[tail - 1] == '\0') {
+        --tail;
+        --size_;
+      }
+    }
+    buffer_offset_ = size_;
+  }
+  if (direct_io_ && size_ % kDirectAlignment != 0) {
+    // appending to an earlier file: its partial last block is rewritten with the new data
+    buffer_offset_ = size_ - size_ % kDirectAlignment;
+    buffer_length_ = static_cast<size_t>(size_ - buffer_offset_);
+    if (reader < 0 || pread(reader, buffer_.get(), buffer_length_, static_cast<off_t>(buffer_offset_))
+        != static_cast<ssize_t>(buffer_length_)) {
+      std::memset(buffer_.get(), 0, buffer_length_);
+    }
+  }
+  if (reader >= 0)
+    ::close(reader);
+  if (options_.preallocate_bytes > size_) {
+    // best effort, file systems without fallocate just grow the file; the size is kept, so
+    // readers and a restart after a crash see only written data, never a zero filled tail
+    (void) fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(options_.preallocate_bytes));
+  }
+  return true;
+#else
+  (void) path;
+  return false;
+#endif
+}
+
+void LogFile::close() {
+  if (fd_ < 0)
+    return;
+  if (segment_mode_) {
+    flush();
+    // drops the unused preallocation, and the padding of a direct I/O tail
+    if (ftruncate(fd_, static_cast<off_t>(size_)) != 0)
+      std::cerr << "Unable to truncate log file" << std::endl;
+  }
+  ::close(fd_);
+  fd_ = -1;
+}
+
+bool LogFile::write(const std::string_view *buffers, size_t count) {
+  if (fd_ < 0)
+    return false;
+  if (segment_mode_) {
+    bool ok = true;
+    for (size_t i = 0; i < count; ++i) {
+      const char *data = buffers[i].data();
+      size_t left = buffers[i].size();
+      while (left > 0) {
+        size_t chunk = std::min(left, kSegmentBuffer - buffer_length_);
+        std::memcpy(buffer_.get() + buffer_length_, data, chunk);
+        buffer_length_ += chunk;
+        size_ += chunk;
+        data += chunk;
+        left -= chunk;
+        if (buffer_length_ == kSegmentBuffer) {
+          ok = writeAt(buffer_.get(), kSegmentBuffer, buffer_offset_) && ok;
+          buffer_offset_ += kSegmentBuffer;
+          buffer_length_ = 0;
+        }
+      }
+    }
+    return ok;
+  }
+  iovec iov[kMaxIovecs];
+  size_t next = 0;
+  size_t skip = 0; // bytes of buffers[next] already written
+  while (next < count) {
+    size_t n = std::min(count - next, kMaxIovecs);
+    for (size_t i = 0; i < n; ++i) {
+      iov[i].iov_base = const_cast<char *>(buffers[next + i].data());
+      iov[i].iov_len = buffers[next + i].size();
+    }
+    iov[0].iov_base = static_cast<char *>(iov[0].iov_base) + skip;
+    iov[0].iov_len -= skip;
+    ssize_t written = writev(fd_, iov, static_cast<int>(n));
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    size_ += static_cast<uint64_t>(written);
+    physical_bytes_ += static_cast<uint64_t>(written);
+    // skip what was written, the rest of a partly written buffer goes first next time
+    auto left = static_cast<size_t>(written);
+    size_t done = 0;
+    while (done < n && left >= iov[done].iov_len) {
+      left -= iov[done].iov_len;
+      ++done;
+      skip = 0;
+    }
+    if (done == 0 && left == 0)
+      return false; // no progress
+    next += done;
+    skip += left;
+  }
+  return true;
+}
+
+bool LogFile::writeAt(const char *data, size_t length, uint64_t offset) {
+  while (length > 0) {
+    ssize_t written = pwrite(fd_, data, length, static_cast<off_t>(offset));
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    physical_bytes_ += static_cast<uint64_t>(written);
+    data += written;
+    length -= static_cast<size_t>(written);
+    offset += static_cast<uint64_t>(written);
+  }
+  return true;
+}
+
+bool LogFile::flush() {
+  if (fd_ < 0)
+    return false;
+  if (!segment_mode_ || buffer_length_ == 0)
+    return true;
+  if (!direct_io_) {
+    bool ok = writeAt(buffer_.get(), buffer_length_, buffer_offset_);
+    buffer_offset_ += buffer_length_;
+    buffer_length_ = 0;
+    return ok;
+  }
+  // whole blocks only: the partial last one goes out zero padded and stays buffered
+  size_t padded = (buffer_length_ + kDirectAlignment - 1) / kDirectAlignment * kDirectAlignment;
+  std::memset(buffer_.get() + buffer_length_, 0, padded - buffer_length_);
+  bool ok = writeAt(buffer_.get(), padded, buffer_offset_);
+  size_t complete = buffer_length_ / kDirectAlignment * kDirectAlignment;
+  std::memmove(buffer_.get(), buffer_.get() + complete, buffer_length_ - complete);
+  buffer_offset_ += complete;
+  buffer_length_ -= complete;
+  return ok;
+}
+
+bool LogFile::sync() {
+  if (!flush())
+    return false;
+#ifdef __APPLE__
+  return fsync(fd_) == 0;
+#else
+  return fdatasync(fd_) == 0;
+#endif
+}
+
+#endif
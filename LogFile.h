@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+struct LogFileOptions {
+  // segment mode: blocks for this size are allocated up front, 0 to grow by appends
+  uint64_t preallocate_bytes = 0;
+  // segment mode, bypassing the page cache (Linux)
+  bool direct_io = false;
+};
+
+/*
+ * Append-only log file, in one of two modes:
+ *  - plain: no user space buffer, callers hand over a whole batch of lines, which goes to
+ *    the kernel with one writev() (per 1024 lines)
+ *  - segment (Linux): the blocks for the full size are fallocated when opened, keeping the
+ *    file size, so appends cause no extent allocation, and written through an aligned 1 MB
+ *    buffer with pwrite(), optionally with O_DIRECT; close() truncates it to the size actually
+ *    written, dropping the unused blocks.
+ *    Under O_DIRECT a partial last block is written padded and rewritten once it fills up,
+ *    which is what physicalBytes() exceeding the logical size measures.
+ */
+class LogFile {
+ public:
+  explicit LogFile(const LogFileOptions &options = LogFileOptions());
+  ~LogFile();
+  LogFile(const LogFile &) = delete;
+  LogFile &operator=(const LogFile &) = delete;
+
+  // Opens path for appending, creating it if needed; false on error
+  bool open(const std::string &path);
+  void close();
+  bool isOpen() const;
+  // Appends the buffers in order, short writes are resumed; false on error
+  bool write(const std::string_view *buffers, size_t count);
+  // Hands buffered data to the kernel (segment mode), false on error
+  bool flush();
+  // Flushes, then forces the written data to disk; false on error
+  bool sync();
+  // Bytes of log data in the file, including what is still buffered
+  uint64_t size() const;
+  // Bytes handed to the kernel since construction, padding and rewrites included
+  uint64_t physicalBytes() const;
+
+ private:
+  struct AlignedDeleter {
+    void operator()(char *buffer) const;
+  };
+
+  LogFileOptions options_;
+  bool segment_mode_;
+  bool direct_io_ = false;
+  int fd_ = -1;
+  uint64_t size_ = 0;
+  std::atomic<uint64_t> physical_bytes_{0};
+  // segment mode: buffer_ holds the file content from buffer_offset_ on
+  std::unique_ptr<char, AlignedDeleter> buffer_;
+  uint64_t buffer_offset_ = 0;
+  size_t buffer_length_ = 0;
+
+  bool writeAt(const char *data, size_t length, uint64_t offset);
+  bool openSegment(const std::string &path);
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "FrameRef.h"
+#include "SyslogParser.h"
+
+/*
+ * One message on its way to the sinks: the shared frame, its severity (-1 without a
+ * valid PRI) and the time it was generated as epoch nanoseconds, parsed from the header
+ * (-1 when unknown). Facility, hostname, the address of the sender and the route are only
+ * filled in for the routing table (see LogRouter).
+ */
+struct LogRecord {
+  FrameRef frame;
+  int severity = -1;
+  int64_t timestamp_ns = -1;
+  int facility = -1;
+  SyslogHeader::Span hostname; // in frame
+  std::shared_ptr<const std::string> client_ip; // shared by the records of a connection
+  int route = -1; // file route chosen by a rule, -1 to match the routes
+};
@@ -0,0 +1,175 @@
+#include "LogRouter.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <system_error>
+#include <utility>
+
+#include "Metrics.h"
+
+namespace {
+
+std::string_view nameOrEmpty(const char *name) {
+  return name != nullptr ? std::string_view(name) : std::string_view();
+}
+
+// values come from the network: anything but a plain name could leave the log directory
+void appendPathComponent(std::string &path, std::string_view value) {
+  if (value.empty()) {
+    path += "unknown";
+    return;
+  }
+  for (size_t i = 0; i < value.size(); ++i) {
+    char c = value[i];
+    bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_'
+        || (c == '.' && i > 0);
+    path += plain ? c : '_';
+  }
+}
+
+}
+
+LogRouter::LogRouter(std::vector<RouteConfig> routes, size_t max_open_files, bool sync_on_close)
+    : routes_(std::move(routes)),
+      max_open_files_(std::max<size_t>(1, max_open_files)),
+      sync_on_close_(sync_on_close),
+      opens_(Metrics::instance().counter("route.opens")),
+      evictions_(Metrics::instance().counter("route.evictions")) {}
+
+LogRouter::~LogRouter() {
+  close();
+}
+
+bool LogRouter::isEnabled() const {
+  return !routes_.empty();
+}
+
+bool LogRouter::matches(const RouteConfig &route, const LogRecord &record, std::string_view host) {
+  if (route.rule_only)
+    return false;
+  if (!route.host.empty() && route.host != host)
+    return false;
+  if (!route.client_ip.empty() && (!record.client_ip || *record.client_ip != route.client_ip))
+    return false;
+  if (route.facility >= 0 && record.facility != route.facility)
+    return false;
+  // messages without a valid PRI only go to routes taking every severity
+  return route.max_severity >= 7 || (record.severity >= 0 && record.severity <= route.max_severity);
+}
+
+void LogRouter::expand(const std::string &pattern, const LogRecord &record, std::string_view host) {
+  path_.clear();
+  size_t pos = 0;
+  while (pos < pattern.size()) {
+    size_t start = pattern.find('%', pos);
+    size_t end = start == std::string::npos ? std::string::npos : pattern.find('%', start + 1);
+    if (end == std::string::npos) {
+      path_.append(pattern, pos, std::string::npos);
+      break;
+    }
+    path_.append(pattern, pos, start - pos);
+    std::string_view name(pattern.data() + start + 1, end - start - 1);
+    if (name == "host") {
+      appendPathComponent(path_, host);
+    } else if (name == "client_ip") {
+      appendPathComponent(path_, record.client_ip ? std::string_view(*record.client_ip) : std::string_view());
+    } else if (name == "facility") {
+      appendPathComponent(path_, nameOrEmpty(SyslogHeader::facilityName(record.facility)));
+    } else if (name == "severity") {
+      appendPathComponent(path_, nameOrEmpty(SyslogHeader::severityName(record.severity)));
+    } else {
+      // not a placeholder, keep the first '%' and look for one starting at the second
+      path_ += '%';
+      pos = start + 1;
+      continue;
+    }
+    pos = end + 1;
+  }
+}
+
+bool LogRouter::route(const LogRecord &record, std::string_view line) {
+  std::string_view frame = record.frame.frame();
+  std::string_view host = record.hostname.in(frame);
+  for (size_t i = 0; i < routes_.size(); ++i) {
+    const RouteConfig &route = routes_[i];
+    if (record.route >= 0 ? i != static_cast<size_t>(record.route) : !matches(route, record, host))
+      continue;
+    expand(route.path, record, host);
+    auto it = destinations_.find(path_);
+    if (it == destinations_.end()) {
+      it = destinations_.emplace(std::piecewise_construct, std::forward_as_tuple(path_), std::forward_as_tuple()).first;
+      it->second.path = &it->first;
+    }
+    Destination &destination = it->second;
+    if (destination.lines.empty())
+      pending_.push_back(&destination);
+    destination.lines.push_back(line);
+    return true;
+  }
+  return false;
+}
+
+bool LogRouter::open(const std::string &path, Destination &destination) {
+  ++opens_;
+  if (destination.file.open(path))
+    return true;
+  std::error_code error;
+  std::filesystem::path parent = std::filesystem::path(path).parent_path();
+  if (!parent.empty() && std::filesystem::create_directories(parent, error) && destination.file.open(path))
+    return true;
+  std::cerr << "Unable to open log file " << path << std::endl;
+  return false;
+}
+
+uint64_t LogRouter::flush() {
+  uint64_t bytes = 0;
+  for (Destination *destination : pending_) {
+    const std::string &path = *destination->path;
+    if (destination->file.isOpen()) {
+      lru_.erase(destination->lru);
+    } else if (!open(path, *destination)) {
+      destinations_.erase(destinations_.find(path));
+      continue;
+    }
+    lru_.push_front(destination);
+    destination->lru = lru_.begin();
+    if (!destination->file.write(destination->lines.data(), destination->lines.size())) {
+      std::cerr << "Unable to write log file " << path << std::endl;
+    }
+    for (std::string_view line : destination->lines) {
+      bytes += line.size();
+    }
+    destination->lines.clear();
+    destination->unsynced = true;
+  }
+  pending_.clear();
+  // close the least recently written files beyond the limit
+  while (lru_.size() > max_open_files_) {
+    Destination *destination = lru_.back();
+    lru_.pop_back();
+    if (sync_on_close_ && destination->unsynced)
+      destination->file.sync();
+    destination->file.close();
+    ++evictions_;
+    destinations_.erase(destinations_.find(*destination->path));
+  }
+  return bytes;
+}
+
+void LogRouter::sync() {
+  for (Destination *destination : lru_) {
+    if (destination->unsynced && !destination->file.sync())
+      std::cerr << "Unable to sync log file " << *destination->path << std::endl;
+    destination->unsynced = false;
+  }
+}
+
+void LogRouter::close() {
+  for (Destination *destination : lru_) {
+    destination->file.close();
+  }
+  lru_.clear();
+  pending_.clear();
+  destinations_.clear();
+}
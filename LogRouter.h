@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "LogFile.h"
+#include "LogRecord.h"
+
+// One entry of the routing table, empty filters match everything
+struct RouteConfig {
+  std::string host;
+  std::string client_ip;
+  int facility = -1;
+  int max_severity = 7; // routes this severity and the more severe ones
+  // %host%, %client_ip%, %facility% and %severity% are replaced by the values of the message
+  std::string path;
+  // the destination of a route rule (see RuleEngine), not matched against the filters above
+  bool rule_only = false;
+};
+
+/*
+ * Sends records to per sender files instead of the main log: the route chosen by a rule, or
+ * else the first route matching hostname, client IP, facility and severity of a record, names
+ * its file. Lines are collected per destination for a whole batch and written with one
+ * writev() per file; the most recently written max_open_files stay open, older ones are
+ * closed, so thousands of senders cost an open only when they come back after a while.
+ * Routed files are appended to, not rotated.
+ */
+class LogRouter {
+ public:
+  // sync_on_close: files closed to make room are synced first, for the durability policies
+  LogRouter(std::vector<RouteConfig> routes, size_t max_open_files, bool sync_on_close);
+  ~LogRouter();
+  bool isEnabled() const;
+  // Queues the line of the record for its destination, false when no route matches.
+  // The line has to stay valid until flush().
+  bool route(const LogRecord &record, std::string_view line);
+  // Writes the queued lines, returns their bytes
+  uint64_t flush();
+  // Forces the files written since the last sync to disk
+  void sync();
+  void close();
+
+ private:
+  struct Destination {
+    const std::string *path = nullptr; // the key in destinations_
+    LogFile file;
+    std::vector<std::string_view> lines;
+    std::list<Destination *>::iterator lru;
+    bool unsynced = false;
+  };
+
+  const std::vector<RouteConfig> routes_;
+  const size_t max_open_files_;
+  const bool sync_on_close_;
+  std::unordered_map<std::string, Destination> destinations_;
+  // open destinations, most recently written first
+  std::list<Destination *> lru_;
+  // destinations with lines queued in this batch
+  std::vector<Destination *> pending_;
+  std::string path_;
+  std::atomic<uint64_t> &opens_;
+  std::atomic<uint64_t> &evictions_;
+
+  static bool matches(const RouteConfig &route, const LogRecord &record, std::string_view host);
+  void expand(const std::string &pattern, const LogRecord &record, std::string_view host);
+  bool open(const std::string &path, Destination &destination);
+};
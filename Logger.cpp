@@ -5,18 +5,31 @@
 #include "ScreenLogger.h"
 #include "FileLogger.h"
 
-Logger::Logger(const Config &cfg) : screen_queue_(MemoryBoundedQueue<std::string>(cfg.getMaxMemorySizeKb() * 1024)),
-                                    file_queue_(MemoryBoundedQueue<std::string>(cfg.getMaxMemorySizeKb() * 1024)),
-                                    screen_logger_(screen_queue_),
-                                    file_logger_(file_queue_, cfg.getFileMaxSizeKb() * 1024),
-                                    is_output_to_screen_(cfg.isOutputToScreen()) {
-  priority_color_map_ = {
-      {3, cfg.getErrorSeverityColorCode()},
-      {6, cfg.getInfoSeverityColorCode()},
-      {7, cfg.getDebugSeverityColorCode()}};
+Logger::Logger(const Config &cfg) : rules_(cfg.getRules()),
+                                    file_queue_("file",
+                                                cfg.getSeverityLanes(),
+                                                cfg.getFileOverflowPolicy(),
+                                                cfg.getSpillDirectory()),
+                                    file_logger_(file_queue_,
+                                                 cfg.getFileMaxSizeKb() * 1024,
+                                                 cfg.getFileDurability(),
+                                                 fileOptions(cfg),
+                                                 cfg.getFileRotation(),
+                                                 cfg.getFileRoutes(),
+                                                 cfg.getRouteOpenFiles(),
+                                                 cfg.getFileTemplate()),
+                                    is_output_to_screen_(cfg.isOutputToScreen()),
+                                    keep_sender_(!cfg.getFileRoutes().empty() || file_logger_.needsClientIp()) {
   file_thread_ = std::thread(&FileLogger::run, &file_logger_);
-  if (is_output_to_screen_)
-    screen_thread_ = std::thread(&ScreenLogger::run, &screen_logger_);
+  if (is_output_to_screen_) {
+    // only when used, the lanes preallocate their rings
+    screen_queue_ = std::make_unique<SeverityQueue>("screen",
+                                                    cfg.getSeverityLanes(),
+                                                    cfg.getScreenOverflowPolicy(),
+                                                    cfg.getSpillDirectory());
+    screen_logger_ = std::make_unique<ScreenLogger>(*screen_queue_, cfg.getSeverityColors());
+    screen_thread_ = std::thread(&ScreenLogger::run, screen_logger_.get());
+  }
 }
 
 Logger::~Logger() {
@@ -29,75 +42,57 @@ Logger::~Logger() {
   }
 }
 
-size_t Logger::processMessage(const char *input) {
-  message_ = std::string(input);
-
-  file_queue_.push(message_);
-  // prefix with color and append with reset color
-  const std::string screenStr = message_;
-  if (is_output_to_screen_) {
-    screen_queue_.push(screenStr);
+void Logger::processMessage(std::string_view frame,
+                            const SyslogHeader &header,
+                            int64_t timestamp_ns,
+                            const std::shared_ptr<const std::string> &client_ip) {
+  RuleEngine::Decision decision;
+  if (rules_.isEnabled()) {
+    decision = rules_.evaluate(frame, header, client_ip.get());
+    if (decision.action == RuleAction::Drop)
+      return;
   }
-  return message_.length(); // return the processed size
-}
-
-void Logger::startColorLine(int priority_digit) {
-  if (is_output_to_screen_) {
-    screen_queue_.push(getAnsiColorCode(getColorCode(priority_digit)));
+  // one entry per line, so lines of concurrent clients cannot interleave; the sinks share the copy
+  LogRecord record;
+  record.frame = FrameRef::create(frame);
+  record.severity = decision.action == RuleAction::Rewrite ? decision.severity : header.severity;
+  record.timestamp_ns = timestamp_ns;
+  if (keep_sender_) {
+    record.facility = header.facility;
+    record.hostname = header.hostname;
+    record.client_ip = client_ip;
+    record.route = decision.route;
   }
-}
-
-void Logger::endLine() {
-  file_queue_.push("\n");
   if (is_output_to_screen_) {
-    screen_queue_.push("\x1b[0m\n");
+    screen_queue_->push(record);
   }
+  file_queue_.push(std::move(record));
 }
 
-int Logger::getColorCode(int priority_digit) const {
-  auto it = priority_color_map_.find(priority_digit);
-  if (it != priority_color_map_.end()) {
-    return it->second;
-  }
-  return 1000; // Return 1000 if not found to signify unsupported priority
-}
-
-std::string Logger::getAnsiColorCode(int colorCode) {
-  switch (colorCode) {
-    case 0: return "\x1b[30m"; // Black
-    case 1: return "\x1b[34m"; // Blue
-    case 2: return "\x1b[32m"; // Green
-    case 3: return "\x1b[36m"; // Cyan
-    case 4: return "\x1b[31m"; // Red
-    case 5: return "\x1b[35m"; // Magenta
-    case 6: return "\x1b[33m"; // Yellow
-    case 7: return "\x1b[37m"; // White
-    case 8: return "\x1b[90m"; // Bright Black (Gray)
-    case 9: return "\x1b[94m"; // Bright Blue
-    case 10: return "\x1b[92m"; // Bright Green
-    case 11: return "\x1b[96m"; // Bright Cyan
-    case 12: return "\x1b[91m"; // Bright Red
-    case 13: return "\x1b[95m"; // Bright Magenta
-    case 14: return "\x1b[93m"; // Bright Yellow
-    case 15: return "\x1b[97m"; // Bright White
-    default: return "\x1b[0m"; // Reset
-  }
+LogFileOptions Logger::fileOptions(const Config &cfg) {
+  LogFileOptions options;
+  if (cfg.isFilePreallocated())
+    options.preallocate_bytes = cfg.getFileMaxSizeKb() * 1024;
+  options.direct_io = cfg.isFileDirectIo();
+  return options;
 }
 
 void Logger::stopLoggers() {
-  screen_logger_.stop();
+  if (is_output_to_screen_) {
+    screen_logger_->stop();
+    screen_queue_->shutdown(); // wake the logger if it is waiting for messages
+  }
   file_logger_.stop();
-  // Push empty messages to unblock queues if they are waiting
-  screen_queue_.push("");
-  file_queue_.push("");
+  file_queue_.shutdown();
 }
 
 void Logger::stopWaitLoggers() {
-  screen_logger_.stopWaitFinished();
+  if (is_output_to_screen_) {
+    screen_logger_->stopWaitFinished();
+    screen_queue_->shutdown(); // wake the logger if it is waiting for messages
+  }
   file_logger_.stopWaitFinished();
-  // Push empty messages to unblock queues if they are waiting
-  screen_queue_.push("");
-  file_queue_.push("");
+  file_queue_.shutdown();
   if (file_thread_.joinable()) {
     file_thread_.join();
   }
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <memory>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <thread>
 
 #include "Config.h"
-#include "ThreadSafeQueue.h"
+#include "LogRecord.h"
+#include "RuleEngine.h"
 #include "ScreenLogger.h"
 #include "FileLogger.h"
 
@@ -12,28 +15,27 @@ class Logger {
  public:
   explicit Logger(const Config &cfg);
   virtual ~Logger();
-  size_t processMessage(const char *input);
-  void startColorLine(int priority_digit);
-  void endLine();
+  // Queues one complete syslog frame to every sink, safe to call from any client thread
+  void processMessage(std::string_view frame,
+                      const SyslogHeader &header,
+                      int64_t timestamp_ns,
+                      const std::shared_ptr<const std::string> &client_ip);
   void stopWaitLoggers();
 
  private:
 //  SyslogBatcher batcher;
-  MemoryBoundedQueue<std::string> screen_queue_;
-  MemoryBoundedQueue<std::string> file_queue_;
-  ScreenLogger screen_logger_;
+  const RuleEngine rules_;
+  SeverityQueue file_queue_;
   FileLogger file_logger_;
+  // with screen output only
+  std::unique_ptr<SeverityQueue> screen_queue_;
+  std::unique_ptr<ScreenLogger> screen_logger_;
   std::thread screen_thread_;
   std::thread file_thread_;
-  std::string message_;
-  /*
-   * the key is an int and represents the severity level encoded in the syslog message
-   * <166> -> level 6 (facility*8+severity)
-   */
-  std::unordered_map<int, int> priority_color_map_;
   bool is_output_to_screen_ = false;
+  // records carry the fields of the sender only for the routes and templates using them
+  bool keep_sender_ = false;
 
-  static std::string getAnsiColorCode(int colorCode);
-  int getColorCode(int priority_digit) const;
+  static LogFileOptions fileOptions(const Config &cfg);
   void stopLoggers();
 };
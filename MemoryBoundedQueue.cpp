@@ -1,13 +1,59 @@
 #include "MemoryBoundedQueue.h"
 
-#include <string>
+#include <cstring>
 
-template<typename T>
-size_t MemoryBoundedQueue<T>::estimateMemoryUsage(const T& item) {
-  return sizeof(item);
+template<>
+size_t MemoryBoundedQueue<LogRecord>::estimateMemoryUsage(const LogRecord &item) {
+  return item.frame.memoryUsage();
+}
+
+template<>
+int MemoryBoundedQueue<LogRecord>::severityOf(const LogRecord &item) {
+  return item.severity;
 }
 
 template<>
-size_t MemoryBoundedQueue<std::string>::estimateMemoryUsage(const std::string &item) {
-  return sizeof(std::string) + item.capacity() * sizeof(char);
-}
\ No newline at end of file
+bool MemoryBoundedQueue<LogRecord>::serialize(const LogRecord &item, std::string &out) {
+  // severity, timestamp, route, client IP, then the frame, in host byte order: spill files never leave the machine
+  auto severity = static_cast<int32_t>(item.severity);
+  auto route = static_cast<int32_t>(item.route);
+  auto client_ip_length = static_cast<uint16_t>(item.client_ip ? item.client_ip->size() : 0);
+  out.append(reinterpret_cast<const char *>(&severity), sizeof(severity));
+  out.append(reinterpret_cast<const char *>(&item.timestamp_ns), sizeof(item.timestamp_ns));
+  out.append(reinterpret_cast<const char *>(&route), sizeof(route));
+  out.append(reinterpret_cast<const char *>(&client_ip_length), sizeof(client_ip_length));
+  if (client_ip_length > 0)
+    out.append(*item.client_ip, 0, client_ip_length);
+  out.append(item.frame.frame());
+  return true;
+}
+
+template<>
+bool MemoryBoundedQueue<LogRecord>::deserialize(std::string_view data, LogRecord &item) {
+  int32_t severity;
+  int32_t route;
+  uint16_t client_ip_length;
+  const size_t fixed = sizeof(severity) + sizeof(item.timestamp_ns) + sizeof(route) + sizeof(client_ip_length);
+  if (data.size() < fixed)
+    return false;
+  const char *p = data.data();
+  std::memcpy(&severity, p, sizeof(severity));
+  p += sizeof(severity);
+  std::memcpy(&item.timestamp_ns, p, sizeof(item.timestamp_ns));
+  p += sizeof(item.timestamp_ns);
+  std::memcpy(&route, p, sizeof(route));
+  p += sizeof(route);
+  std::memcpy(&client_ip_length, p, sizeof(client_ip_length));
+  if (data.size() < fixed + client_ip_length)
+    return false;
+  item.severity = severity;
+  item.route = route;
+  if (client_ip_length > 0)
+    item.client_ip = std::make_shared<const std::string>(data.substr(fixed, client_ip_length));
+  item.frame = FrameRef::create(data.substr(fixed + client_ip_length));
+  // the routing fields point into the frame, parsing it again is cheaper than storing them
+  SyslogHeader header = SyslogParser::parse(item.frame.frame());
+  item.facility = header.facility;
+  item.hostname = header.hostname;
+  return true;
+}
@@ -1,44 +1,402 @@
 #pragma once
 
-#include "ThreadSafeQueue.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
 
+#include "Futex.h"
+#include "LogRecord.h"
+#include "Metrics.h"
+#include "OverflowPolicy.h"
+#include "SpillStore.h"
+
+/*
+ * Bounded multi-producer single-consumer ring (D. Vyukov's sequence numbered cells):
+ * producers claim a cell with one CAS and never lock. Besides the number of cells, the
+ * queued items are limited to max_memory_bytes, counting the heap memory each one holds;
+ * what happens to an item beyond that is up to the OverflowPolicy. A full ring blocks
+ * producers under Block, spills under Spill and drops the new item otherwise.
+ * Once an item spilled, all following ones do until the consumer has read the spill back
+ * (after what was in the ring), so every producer's items stay in order.
+ * Nobody sleeps on a lock: the consumer parks on a futex only when the ring is empty,
+ * producers only when it is full, and each side issues a wake syscall only when the other
+ * is actually parked. Parked producers are released together once the queue drained to half
+ * of its limits, rather than one wake per popped item.
+ */
 template<typename T>
-class MemoryBoundedQueue : public ThreadSafeQueue<T> {
+class MemoryBoundedQueue {
  private:
-  size_t max_memory_bytes_;
-  size_t current_memory_bytes_ = 0;
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+    size_t memory_bytes;
+  };
+
+  static constexpr size_t kDefaultCapacity = 64 * 1024;
+
+  const size_t max_memory_bytes_;
+  const OverflowPolicy policy_;
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+  alignas(64) std::atomic<size_t> enqueue_pos_{0};
+  // only advanced by the consumer, and by producers evicting under DropOldest
+  alignas(64) std::atomic<size_t> dequeue_pos_{0};
+  alignas(64) std::atomic<size_t> current_memory_bytes_{0};
+  // 1 while the consumer is parked, possibly shared with other queues of the same consumer
+  Futex own_consumer_idle_;
+  Futex &consumer_idle_;
+  // bumped by the consumer when space was freed while producers are parked
+  Futex space_freed_;
+  std::atomic<uint32_t> waiting_producers_{0};
+  std::atomic<bool> shut_down_{false};
+  std::atomic<uint64_t> &dropped_;
+  // Spill policy only; the mutex orders producers and the end of spilling, never held for disk I/O
+  std::unique_ptr<SpillStore> spill_;
+  std::mutex spill_mutex_;
+  std::atomic<bool> spilling_{false};
+  std::string spill_record_;
+  std::string read_record_; // consumer only
 
+  // heap memory held by an item
   size_t estimateMemoryUsage(const T &item);
+  // syslog severity of an item, -1 when unknown
+  int severityOf(const T &item);
+  // spill format of an item, false for types that cannot spill
+  bool serialize(const T &item, std::string &out);
+  bool deserialize(std::string_view data, T &item);
+
+  static size_t roundUpToPowerOfTwo(size_t value) {
+    size_t result = 2;
+    while (result < value)
+      result <<= 1;
+    return result;
+  }
+
+  // a lone item may exceed the limit, it would never fit otherwise
+  bool reserveMemory(size_t item_size, size_t limit) {
+    size_t current = current_memory_bytes_.load(std::memory_order_relaxed);
+    do {
+      if (current != 0 && current + item_size > limit)
+        return false;
+    } while (!current_memory_bytes_.compare_exchange_weak(current, current + item_size));
+    return true;
+  }
+
+  // budget share of an item under DropBySeverity: 4/8 for debug and unknown, 5/8 for info, 6/8 for
+  // notice, 7/8 for warning and all of it for error and worse
+  size_t severityLimit(int severity) const {
+    int importance = severity < 0 || severity > 7 ? 0 : 7 - severity;
+    return max_memory_bytes_ / 8 * static_cast<size_t>(4 + (importance < 4 ? importance : 4));
+  }
+
+  bool tryEnqueue(T &value, size_t item_size) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[pos & mask_];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.memory_bytes = item_size;
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false; // full
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Moves the oldest item into out without releasing its memory, false when empty
+  bool tryDequeue(T &out, size_t &item_size) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[pos & mask_];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          // move constructed, so nothing of the item stays behind in the cell
+          T value(std::move(cell.value));
+          item_size = cell.memory_bytes;
+          cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          out = std::move(value);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false; // empty
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // DropOldest: discards queued items until the new one fits, false if it still does not
+  bool evictFor(size_t item_size) {
+    while (!reserveMemory(item_size, max_memory_bytes_)) {
+      T evicted;
+      size_t evicted_size;
+      if (!tryDequeue(evicted, evicted_size))
+        return false;
+      ++dropped_;
+      releaseMemory(evicted_size);
+    }
+    return true;
+  }
+
+  // Spill: false when the item should go to the ring after all
+  bool trySpill(const T &value, size_t item_size) {
+    std::lock_guard<std::mutex> lock(spill_mutex_);
+    if (!spilling_) {
+      if (reserveMemory(item_size, max_memory_bytes_))
+        return false;
+      spilling_ = true;
+    }
+    appendSpill(value);
+    return true;
+  }
+
+  // Spill, with spill_mutex_ held: the store only buffers, its own thread writes the segments
+  void appendSpill(const T &value) {
+    spill_record_.clear();
+    if (!serialize(value, spill_record_) || !spill_->append(spill_record_))
+      ++dropped_;
+  }
+
+  // Spill: reads back up to max_items items, ends spilling once nothing is left
+  size_t readSpill(std::vector<T> &out, size_t max_items, size_t max_bytes) {
+    // the files are read without spill_mutex_, producers keep appending meanwhile
+    size_t count = 0;
+    size_t bytes = 0;
+    T value;
+    while (count < max_items && bytes < max_bytes && spill_->read(read_record_)) {
+      bytes += read_record_.size();
+      if (!deserialize(read_record_, value))
+        continue;
+      out.emplace_back(std::move(value));
+      ++count;
+    }
+    // under the lock, so no producer appends after the store was found empty
+    std::lock_guard<std::mutex> lock(spill_mutex_);
+    if (spill_->empty())
+      spilling_ = false;
+    return count;
+  }
+
+  template<typename Ready>
+  void waitForSpace(Ready ready) {
+    waiting_producers_.fetch_add(1);
+    uint32_t epoch = space_freed_.value.load();
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ready())
+      space_freed_.wait(epoch);
+    waiting_producers_.fetch_sub(1);
+  }
+
+  void wakeConsumer() {
+    // pairs with the fence in waitNotEmpty(): either it sees the new item or we see it parked
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer_idle_.value.load(std::memory_order_relaxed) == 1 && consumer_idle_.value.exchange(0) == 1)
+      consumer_idle_.wakeOne();
+  }
+
+  // parks the consumer until the queue is likely not empty
+  void waitNotEmpty() {
+    consumer_idle_.value.store(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!empty() || spilling_ || shut_down_) {
+      consumer_idle_.value.store(0);
+      return;
+    }
+    consumer_idle_.wait(1);
+  }
+
+  void releaseMemory(size_t item_size) {
+    size_t remaining = current_memory_bytes_.fetch_sub(item_size) - item_size;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_producers_.load(std::memory_order_relaxed) != 0 && remaining <= max_memory_bytes_ / 2
+        && enqueue_pos_.load(std::memory_order_relaxed) - dequeue_pos_.load() <= (mask_ + 1) / 2) {
+      space_freed_.value.fetch_add(1);
+      space_freed_.wakeAll();
+    }
+  }
 
  public:
+  /*
+   * spill_directory is only used by the Spill policy. A consumer serving several queues
+   * passes the same consumer_signal to all of them and parks on it itself (see
+   * tryDrainInto()); pushes to any of the queues then wake it.
+   */
+  MemoryBoundedQueue(const std::string &name,
+                     size_t max_memory_bytes,
+                     OverflowPolicy policy = OverflowPolicy::Block,
+                     const std::string &spill_directory = "spill",
+                     size_t capacity = kDefaultCapacity,
+                     Futex *consumer_signal = nullptr)
+      : max_memory_bytes_(max_memory_bytes),
+        policy_(policy),
+        mask_(roundUpToPowerOfTwo(capacity) - 1),
+        cells_(new Cell[mask_ + 1]),
+        consumer_idle_(consumer_signal != nullptr ? *consumer_signal : own_consumer_idle_),
+        dropped_(Metrics::instance().counter("queue." + name + ".dropped")) {
+    for (size_t i = 0; i <= mask_; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    Metrics::instance().gauge("queue." + name + ".bytes", [this]() -> uint64_t { return getCurrentMemoryUsage(); });
+    if (policy_ == OverflowPolicy::Spill) {
+      spill_ = std::make_unique<SpillStore>(spill_directory, name);
+      spilling_ = !spill_->empty();
+      Metrics::instance().gauge("queue." + name + ".spill_bytes", [this]() -> uint64_t {
+        return spill_->pendingBytes();
+      });
+    }
+  }
+  MemoryBoundedQueue(const MemoryBoundedQueue &) = delete;
+  MemoryBoundedQueue &operator=(const MemoryBoundedQueue &) = delete;
 
-  explicit MemoryBoundedQueue(size_t max_memory_bytes) : max_memory_bytes_(max_memory_bytes) {}
-  void push(T value) override {
-    std::unique_lock<std::mutex> lock(this->mutex_);
+  // Safe from any thread, blocks under the Block policy only
+  void push(T value) {
     size_t item_size = estimateMemoryUsage(value);
-    this->condition_variable_.wait(lock,
-                                   [this, item_size] {
-                                     return (current_memory_bytes_ + item_size) <= max_memory_bytes_;
-                                   });
-
-    this->queue_.push(value);
-    current_memory_bytes_ += item_size;
-    lock.unlock();
-    this->condition_variable_.notify_one();
-  }
-  T pop() override {
-    std::unique_lock<std::mutex> lock(this->mutex_);
-    this->condition_variable_.wait(lock, [this] { return !this->queue_.empty(); });
-
-    T tmp = std::move(this->queue_.front());
-    this->queue_.pop();
-    current_memory_bytes_ -= estimateMemoryUsage(tmp);
-    lock.unlock();
-    this->condition_variable_.notify_one();
-    return tmp;
+    bool admitted = true;
+    switch (policy_) {
+      case OverflowPolicy::Block:
+        while (!reserveMemory(item_size, max_memory_bytes_)) {
+          waitForSpace([this, item_size] {
+            size_t current = current_memory_bytes_.load();
+            return current == 0 || current + item_size <= max_memory_bytes_;
+          });
+        }
+        break;
+      case OverflowPolicy::DropNewest:
+        admitted = reserveMemory(item_size, max_memory_bytes_);
+        break;
+      case OverflowPolicy::DropOldest:
+        admitted = evictFor(item_size);
+        break;
+      case OverflowPolicy::DropBySeverity:
+        admitted = reserveMemory(item_size, severityLimit(severityOf(value)));
+        break;
+      case OverflowPolicy::Spill:
+        if ((spilling_ || !reserveMemory(item_size, max_memory_bytes_)) && trySpill(value, item_size)) {
+          wakeConsumer();
+          return;
+        }
+        break;
+    }
+    if (!admitted) {
+      ++dropped_;
+      return;
+    }
+    while (!tryEnqueue(value, item_size)) {
+      if (policy_ == OverflowPolicy::Spill) {
+        releaseMemory(item_size);
+        std::lock_guard<std::mutex> lock(spill_mutex_);
+        spilling_ = true;
+        appendSpill(value);
+        wakeConsumer();
+        return;
+      }
+      if (policy_ != OverflowPolicy::Block) {
+        releaseMemory(item_size);
+        ++dropped_;
+        return;
+      }
+      waitForSpace([this] {
+        size_t pos = enqueue_pos_.load();
+        return cells_[pos & mask_].sequence.load() == pos;
+      });
+    }
+    wakeConsumer();
+  }
+
+  // Consumer only, returns false when the queue is empty
+  bool tryPop(T &out) {
+    size_t item_size;
+    if (!tryDequeue(out, item_size))
+      return false;
+    releaseMemory(item_size);
+    return true;
   }
+
+  // Consumer only, blocks until an item arrives or the queue is shut down (returning T())
+  T pop() {
+    T out;
+    while (!tryPop(out)) {
+      if (shut_down_)
+        return T();
+      waitNotEmpty();
+    }
+    return out;
+  }
+
+  /*
+   * Consumer only. Blocks until an item arrives, then moves out everything pending, up to
+   * max_items items or until max_bytes are reached, with a single release of their memory.
+   * Returns the number of items appended to out, 0 once shut down and empty.
+   */
+  size_t drainInto(std::vector<T> &out, size_t max_items, size_t max_bytes) {
+    while (!hasPending()) {
+      if (shut_down_)
+        return 0;
+      waitNotEmpty();
+    }
+    return tryDrainInto(out, max_items, max_bytes);
+  }
+
+  // Consumer only, drainInto() without waiting: 0 when nothing is pending
+  size_t tryDrainInto(std::vector<T> &out, size_t max_items, size_t max_bytes) {
+    if (empty())
+      return spilling_ ? readSpill(out, max_items, max_bytes) : 0;
+    size_t count = 0;
+    size_t bytes = 0;
+    T value;
+    size_t item_size;
+    while (count < max_items && bytes < max_bytes && tryDequeue(value, item_size)) {
+      out.emplace_back(std::move(value));
+      bytes += item_size;
+      ++count;
+    }
+    releaseMemory(bytes);
+    return count;
+  }
+
+  // Wakes the consumer for good, pending items can still be drained
+  void shutdown() {
+    shut_down_ = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer_idle_.value.exchange(0) == 1)
+      consumer_idle_.wakeOne();
+  }
+
+  bool empty() const {
+    size_t pos = dequeue_pos_.load(std::memory_order_acquire);
+    return cells_[pos & mask_].sequence.load(std::memory_order_acquire) != pos + 1;
+  }
+
+  // Items in the ring or spilled to disk
+  bool hasPending() const {
+    return !empty() || spilling_;
+  }
+
   size_t getCurrentMemoryUsage() const {
-    std::lock_guard<std::mutex> lock(this->mutex_);
-    return current_memory_bytes_;
+    return current_memory_bytes_.load(std::memory_order_relaxed);
   }
 };
+
+// the queues hold LogRecords, the item hooks are defined in MemoryBoundedQueue.cpp
+template<>
+size_t MemoryBoundedQueue<LogRecord>::estimateMemoryUsage(const LogRecord &item);
+template<>
+int MemoryBoundedQueue<LogRecord>::severityOf(const LogRecord &item);
+template<>
+bool MemoryBoundedQueue<LogRecord>::serialize(const LogRecord &item, std::string &out);
+template<>
+bool MemoryBoundedQueue<LogRecord>::deserialize(std::string_view data, LogRecord &item);
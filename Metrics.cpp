@@ -0,0 +1,93 @@
+#include "Metrics.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+Metrics &Metrics::instance() {
+  static Metrics metrics;
+  return metrics;
+}
+
+Metrics::~Metrics() {
+  stop();
+}
+
+std::atomic<uint64_t> &Metrics::counter(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &slot = counters_[name];
+  if (!slot) {
+    slot = std::make_unique<std::atomic<uint64_t>>(0);
+  }
+  return *slot;
+}
+
+void Metrics::gauge(const std::string &name, std::function<uint64_t()> read) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  gauges_[name] = std::move(read);
+}
+
+std::string Metrics::report() {
+  std::map<std::string, uint64_t> values;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &it : counters_) {
+      values[it.first] = it.second->load(std::memory_order_relaxed);
+    }
+    for (const auto &it : gauges_) {
+      values[it.first] = it.second();
+    }
+  }
+  std::ostringstream oss;
+  oss << "stats";
+  for (const auto &it : values) {
+    oss << ' ' << it.first << '=' << it.second;
+  }
+  return oss.str();
+}
+
+void Metrics::start(unsigned interval_sec) {
+  if (interval_sec == 0 || reporter_.joinable())
+    return;
+  reporter_ = std::thread([this, interval_sec]() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_cv_.wait_for(lock, std::chrono::seconds(interval_sec), [this] { return stopped_; })) {
+      lock.unlock();
+      std::cout << report() << std::endl;
+      lock.lock();
+    }
+  });
+}
+
+void Metrics::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  stop_cv_.notify_all();
+  if (reporter_.joinable()) {
+    reporter_.join();
+  }
+}
+
+uint64_t Metrics::readNetstat(const std::string &section, const std::string &field) {
+  // pairs of lines: "TcpExt: <names...>" followed by "TcpExt: <values...>"
+  std::ifstream netstat("/proc/net/netstat");
+  std::string names;
+  std::string values;
+  const std::string prefix = section + ":";
+  while (std::getline(netstat, names) && std::getline(netstat, values)) {
+    if (names.compare(0, prefix.size(), prefix) != 0)
+      continue;
+    std::istringstream name_stream(names);
+    std::istringstream value_stream(values);
+    std::string name;
+    std::string value;
+    while (name_stream >> name && value_stream >> value) {
+      if (name == field)
+        return std::stoull(value);
+    }
+  }
+  return 0;
+}
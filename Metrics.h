@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*
+ * Process wide named counters and gauges. Counters are registered on first use and
+ * the returned reference stays valid, so hot paths look them up once and keep it.
+ * When started, the values are printed to stdout every interval as one "stats" line.
+ */
+class Metrics {
+ public:
+  static Metrics &instance();
+  std::atomic<uint64_t> &counter(const std::string &name);
+  void gauge(const std::string &name, std::function<uint64_t()> read);
+  std::string report();
+  void start(unsigned interval_sec);
+  void stop();
+  // Reads a counter of /proc/net/netstat, e.g. ("TcpExt", "ListenOverflows"), 0 if unavailable
+  static uint64_t readNetstat(const std::string &section, const std::string &field);
+
+ private:
+  Metrics() = default;
+  ~Metrics();
+
+  std::mutex mutex_;
+  std::map<std::string, std::unique_ptr<std::atomic<uint64_t>>> counters_;
+  std::map<std::string, std::function<uint64_t()>> gauges_;
+  std::thread reporter_;
+  std::condition_variable stop_cv_;
+  bool stopped_ = false;
+};
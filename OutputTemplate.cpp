@@ -0,0 +1,306 @@
+#include "OutputTemplate.h"
+
+#include <chrono>
+#include <ctime>
+#include <unordered_map>
+
+#include "SimdScan.h"
+
+namespace {
+
+const std::unordered_map<std::string, std::string> kPresets = {
+    {"raw", "%raw%"},
+    {"rfc5424", "<%pri%>1 %timestamp% %host% %app% %procid% %msgid% %sd% %msg%"},
+    {"rfc3164", "<%pri%>%timestamp_bsd% %host% %app%: %msg%"},
+    {"json", "{\"timestamp\":\"%timestamp%\",\"host\":\"%host:json%\",\"app\":\"%app:json%\","
+             "\"procid\":\"%procid:json%\",\"msgid\":\"%msgid:json%\",\"facility\":\"%facility:json%\","
+             "\"severity\":\"%severity:json%\",\"client_ip\":\"%client_ip:json%\",\"msg\":\"%msg:json%\"}"},
+    {"simple", "%timestamp% %host% %app%: %msg%"}};
+
+const char kDigits[] = "0123456789";
+
+void appendDigits(std::string &out, unsigned value, int width) {
+  char digits[10];
+  for (int i = width - 1; i >= 0; --i) {
+    digits[i] = kDigits[value % 10];
+    value /= 10;
+  }
+  out.append(digits, static_cast<size_t>(width));
+}
+
+void appendNumber(std::string &out, unsigned value) {
+  appendDigits(out, value, value >= 100 ? 3 : value >= 10 ? 2 : 1);
+}
+
+int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// length of the well-formed UTF-8 sequence starting at p (RFC 3629), 0 if it is not one
+size_t utf8SequenceLength(const char *p, const char *end) {
+  auto byte = [p](size_t i) { return static_cast<unsigned char>(p[i]); };
+  unsigned char lead = byte(0);
+  size_t length;
+  unsigned char low = 0x80, high = 0xbf; // range of the second byte
+  if (lead >= 0xc2 && lead <= 0xdf) {
+    length = 2;
+  } else if (lead >= 0xe0 && lead <= 0xef) {
+    length = 3;
+    if (lead == 0xe0)
+      low = 0xa0; // overlong
+    else if (lead == 0xed)
+      high = 0x9f; // surrogates
+  } else if (lead >= 0xf0 && lead <= 0xf4) {
+    length = 4;
+    if (lead == 0xf0)
+      low = 0x90; // overlong
+    else if (lead == 0xf4)
+      high = 0x8f; // beyond U+10FFFF
+  } else {
+    return 0;
+  }
+  if (static_cast<size_t>(end - p) < length || byte(1) < low || byte(1) > high)
+    return 0;
+  for (size_t i = 2; i < length; ++i) {
+    if (byte(i) < 0x80 || byte(i) > 0xbf)
+      return 0;
+  }
+  return length;
+}
+
+// floor division, so times before 1970 keep a positive fraction
+int64_t secondOf(int64_t timestamp_ns) {
+  return timestamp_ns >= 0 ? timestamp_ns / 1000000000 : (timestamp_ns + 1) / 1000000000 - 1;
+}
+
+}
+
+OutputTemplate::OutputTemplate(const std::string &format) {
+  auto preset = kPresets.find(format);
+  if (preset != kPresets.end()) {
+    compile(preset->second);
+  } else if (format.find('%') != std::string::npos) {
+    compile(format);
+  } else {
+    compile("%raw%");
+  }
+  raw_ = steps_.size() == 1 && steps_[0].field == Field::Raw && !steps_[0].json;
+}
+
+bool OutputTemplate::isRaw() const {
+  return raw_;
+}
+
+bool OutputTemplate::usesClientIp() const {
+  for (const Step &step : steps_) {
+    if (step.field == Field::ClientIp)
+      return true;
+  }
+  return false;
+}
+
+void OutputTemplate::appendLiteral(std::string_view text) {
+  if (text.empty())
+    return;
+  // adjacent literals are merged, so a line costs one copy per literal run
+  if (!steps_.empty() && steps_.back().field == Field::Literal
+      && steps_.back().offset + steps_.back().length == literals_.size()) {
+    steps_.back().length += static_cast<uint32_t>(text.size());
+  } else {
+    Step step{Field::Literal};
+    step.offset = static_cast<uint32_t>(literals_.size());
+    step.length = static_cast<uint32_t>(text.size());
+    steps_.push_back(step);
+  }
+  literals_.append(text);
+}
+
+void OutputTemplate::compile(const std::string &pattern) {
+  static const std::unordered_map<std::string_view, Field> fields = {
+      {"raw", Field::Raw}, {"pri", Field::Pri}, {"facility", Field::Facility}, {"severity", Field::Severity},
+      {"timestamp", Field::Timestamp}, {"timestamp_bsd", Field::TimestampBsd}, {"host", Field::Host},
+      {"app", Field::App}, {"procid", Field::ProcId}, {"msgid", Field::MsgId}, {"sd", Field::StructuredData},
+      {"msg", Field::Message}, {"client_ip", Field::ClientIp}};
+  size_t pos = 0;
+  while (pos < pattern.size()) {
+    size_t start = pattern.find('%', pos);
+    size_t end = start == std::string::npos ? std::string::npos : pattern.find('%', start + 1);
+    if (end == std::string::npos) {
+      appendLiteral(std::string_view(pattern).substr(pos));
+      break;
+    }
+    appendLiteral(std::string_view(pattern).substr(pos, start - pos));
+    std::string_view name(pattern.data() + start + 1, end - start - 1);
+    bool json = false;
+    if (name.size() > 5 && name.substr(name.size() - 5) == ":json") {
+      json = true;
+      name.remove_suffix(5);
+    }
+    auto field = fields.find(name);
+    if (field == fields.end()) {
+      // not a placeholder, keep the first '%' and look for one starting at the second
+      appendLiteral("%");
+      pos = start + 1;
+      continue;
+    }
+    Step step{field->second};
+    step.json = json;
+    steps_.push_back(step);
+    parse_header_ = parse_header_ || (field->second != Field::Raw && field->second != Field::ClientIp
+        && field->second != Field::Timestamp && field->second != Field::TimestampBsd);
+    pos = end + 1;
+  }
+}
+
+void OutputTemplate::format(const LogRecord &record, std::string &out) {
+  std::string_view frame = record.frame.frame();
+  SyslogHeader header;
+  if (parse_header_)
+    header = SyslogParser::parse(frame);
+  for (const Step &step : steps_) {
+    std::string_view value;
+    switch (step.field) {
+      case Field::Literal:
+        out.append(literals_, step.offset, step.length);
+        continue;
+      case Field::Timestamp:
+        appendTimestamp(record.timestamp_ns, out);
+        continue;
+      case Field::TimestampBsd:
+        appendTimestampBsd(record.timestamp_ns, out);
+        continue;
+      case Field::Pri:
+        // with the severity of the record, a rule may have changed it; RFC 3164 relays give messages
+        // without a PRI user.notice
+        appendNumber(out, header.facility >= 0 && record.severity >= 0
+                              ? static_cast<unsigned>(header.facility * 8 + record.severity) : 13);
+        continue;
+      case Field::Raw: value = frame; break;
+      case Field::Facility: value = header.facility >= 0 ? SyslogHeader::facilityName(header.facility) : ""; break;
+      // the severity of the record, a rule may have changed it
+      case Field::Severity: value = record.severity >= 0 ? SyslogHeader::severityName(record.severity) : ""; break;
+      case Field::Host: value = header.hostname.in(frame); break;
+      case Field::App: value = header.app_name.in(frame); break;
+      case Field::ProcId: value = header.procid.in(frame); break;
+      case Field::MsgId: value = header.msgid.in(frame); break;
+      case Field::StructuredData: value = header.structured_data.in(frame); break;
+      case Field::Message: value = header.message.in(frame); break;
+      case Field::ClientIp: value = record.client_ip ? std::string_view(*record.client_ip) : std::string_view(); break;
+    }
+    if (step.json) {
+      appendJson(value, out);
+    } else if (value.empty() && step.field != Field::Raw && step.field != Field::Message) {
+      out += '-';
+    } else {
+      out.append(value);
+    }
+  }
+  out += '\n';
+}
+
+void OutputTemplate::appendTimestamp(int64_t timestamp_ns, std::string &out) {
+  if (timestamp_ns < 0)
+    timestamp_ns = nowNs();
+  int64_t second = secondOf(timestamp_ns);
+  if (second != rfc3339_second_) {
+    auto time = static_cast<time_t>(second);
+    struct tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &time);
+#else
+    gmtime_r(&time, &utc);
+#endif
+    size_t begin = out.size();
+    appendDigits(out, static_cast<unsigned>(utc.tm_year + 1900), 4);
+    out += '-';
+    appendDigits(out, static_cast<unsigned>(utc.tm_mon + 1), 2);
+    out += '-';
+    appendDigits(out, static_cast<unsigned>(utc.tm_mday), 2);
+    out += 'T';
+    appendDigits(out, static_cast<unsigned>(utc.tm_hour), 2);
+    out += ':';
+    appendDigits(out, static_cast<unsigned>(utc.tm_min), 2);
+    out += ':';
+    appendDigits(out, static_cast<unsigned>(utc.tm_sec), 2);
+    out.copy(rfc3339_.data(), rfc3339_.size(), begin);
+    rfc3339_second_ = second;
+  } else {
+    out.append(rfc3339_.data(), rfc3339_.size());
+  }
+  out += '.';
+  appendDigits(out, static_cast<unsigned>((timestamp_ns - second * 1000000000) / 1000), 6);
+  out += 'Z';
+}
+
+void OutputTemplate::appendTimestampBsd(int64_t timestamp_ns, std::string &out) {
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  if (timestamp_ns < 0)
+    timestamp_ns = nowNs();
+  int64_t second = secondOf(timestamp_ns);
+  if (second != bsd_second_) {
+    auto time = static_cast<time_t>(second);
+    struct tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &time);
+#else
+    localtime_r(&time, &local);
+#endif
+    size_t begin = out.size();
+    out.append(months + local.tm_mon * 3, 3);
+    out += ' ';
+    // the day is space padded
+    out += local.tm_mday < 10 ? ' ' : kDigits[local.tm_mday / 10];
+    out += kDigits[local.tm_mday % 10];
+    out += ' ';
+    appendDigits(out, static_cast<unsigned>(local.tm_hour), 2);
+    out += ':';
+    appendDigits(out, static_cast<unsigned>(local.tm_min), 2);
+    out += ':';
+    appendDigits(out, static_cast<unsigned>(local.tm_sec), 2);
+    out.copy(bsd_.data(), bsd_.size(), begin);
+    bsd_second_ = second;
+  } else {
+    out.append(bsd_.data(), bsd_.size());
+  }
+}
+
+void OutputTemplate::appendJson(std::string_view value, std::string &out) {
+  static const char hex[] = "0123456789abcdef";
+  const char *p = value.data();
+  const char *end = p + value.size();
+  while (p < end) {
+    // plain runs are found a vector at a time and copied as a whole
+    const char *special = SimdScan::findJsonSpecial(p, end);
+    out.append(p, static_cast<size_t>(special - p));
+    if (special == end)
+      break;
+    p = special;
+    auto c = static_cast<unsigned char>(*p);
+    if (c >= 0x80) {
+      // JSON has to be UTF-8, invalid bytes are replaced one by one
+      size_t length = utf8SequenceLength(p, end);
+      if (length > 0) {
+        out.append(p, length);
+        p += length;
+      } else {
+        out += "\\ufffd";
+        ++p;
+      }
+      continue;
+    }
+    out += '\\';
+    switch (c) {
+      case '"': out += '"'; break;
+      case '\\': out += '\\'; break;
+      case '\n': out += 'n'; break;
+      case '\r': out += 'r'; break;
+      case '\t': out += 't'; break;
+      default:
+        out += "u00";
+        out += hex[c >> 4];
+        out += hex[c & 0xf];
+    }
+    ++p;
+  }
+}
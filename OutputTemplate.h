@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "LogRecord.h"
+#include "SyslogParser.h"
+
+/*
+ * Line format of the log files, compiled once from a template such as
+ * "%timestamp% %host% %app%: %msg%" into a list of literal copies and field steps that append
+ * straight to the caller's buffer. Fields: raw, pri, facility, severity, timestamp (RFC 3339,
+ * UTC), timestamp_bsd (local time), host, app, procid, msgid, sd, msg and client_ip; empty
+ * header fields are written as "-", %field:json% writes the field escaped for a JSON string
+ * instead (empty as empty, invalid UTF-8 as U+FFFD), finding the bytes to escape with
+ * SimdScan. Timestamps are the parsed ones of the message, or the time of writing for
+ * messages without one; the date part is formatted once per second.
+ * Presets: raw (the frame as received, written without copying, see isRaw()), rfc5424,
+ * rfc3164, json (one object per line) and simple.
+ */
+class OutputTemplate {
+ public:
+  // A preset name or a template, unknown names are raw
+  explicit OutputTemplate(const std::string &format);
+  bool isRaw() const;
+  bool usesClientIp() const;
+  // Appends the line of the record, newline included
+  void format(const LogRecord &record, std::string &out);
+  // Appends value as the content of a JSON string
+  static void appendJson(std::string_view value, std::string &out);
+
+ private:
+  enum class Field {
+    Literal, Raw, Pri, Facility, Severity, Timestamp, TimestampBsd, Host, App, ProcId, MsgId, StructuredData,
+    Message, ClientIp
+  };
+
+  struct Step {
+    Field field;
+    bool json = false;
+    // Literal: the text in literals_
+    uint32_t offset = 0;
+    uint32_t length = 0;
+  };
+
+  std::vector<Step> steps_;
+  std::string literals_;
+  bool raw_ = false;
+  bool parse_header_ = false;
+  // "YYYY-MM-DDTHH:MM:SS" in UTC and "Mmm dd hh:mm:ss" in local time of the last second formatted
+  int64_t rfc3339_second_ = INT64_MIN;
+  std::array<char, 19> rfc3339_{};
+  int64_t bsd_second_ = INT64_MIN;
+  std::array<char, 15> bsd_{};
+
+  void compile(const std::string &pattern);
+  void appendLiteral(std::string_view text);
+  void appendTimestamp(int64_t timestamp_ns, std::string &out);
+  void appendTimestampBsd(int64_t timestamp_ns, std::string &out);
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+/*
+ * What a MemoryBoundedQueue does with a message that does not fit its memory budget.
+ *  - Block: the producer waits for the consumer, stalling its connection
+ *  - DropNewest: the new message is discarded
+ *  - DropOldest: queued messages are discarded, oldest first, until it fits
+ *  - DropBySeverity: the fuller the queue, the more severities are discarded on arrival;
+ *    debug from half of the budget on, then info, notice and warning, while more severe
+ *    messages get the whole budget
+ *  - Spill: messages go to segment files on disk until the consumer caught up with them
+ */
+enum class OverflowPolicy { Block, DropNewest, DropOldest, DropBySeverity, Spill };
@@ -0,0 +1,235 @@
+#include "Reactor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "SyslogServer.h"
+
+namespace {
+const int kMaxEvents = 256;
+const int kWaitTimeoutMs = 1000;
+// same as the SO_RCVTIMEO used in the thread-per-connection mode
+const std::chrono::seconds kIdleTimeout(60);
+}
+
+Reactor::Reactor(int threads, size_t quantum_bytes) : quantum_bytes_(static_cast<int64_t>(quantum_bytes)) {
+  for (int i = 0; i < threads; ++i) {
+    auto loop = std::make_unique<Loop>();
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->epoll_fd < 0 || loop->wake_fd < 0) {
+      throw std::runtime_error("Unable to create the reactor event loop.");
+    }
+    // a null data pointer identifies the wakeup descriptor
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &event) < 0) {
+      throw std::runtime_error("Unable to register the reactor wakeup descriptor.");
+    }
+    loops_.push_back(std::move(loop));
+  }
+}
+
+Reactor::~Reactor() {
+  stop();
+  join();
+  for (auto &loop : loops_) {
+    close(loop->wake_fd);
+    close(loop->epoll_fd);
+  }
+}
+
+void Reactor::start() {
+  running_ = true;
+  for (auto &loop : loops_) {
+    loop->thread = std::thread(&Reactor::runLoop, this, std::ref(*loop));
+  }
+}
+
+void Reactor::add(const std::shared_ptr<SyslogServerThread> &connection) {
+  Loop &loop = *loops_[next_loop_++ % loops_.size()];
+  {
+    std::lock_guard<std::mutex> lock(loop.pending_mutex);
+    loop.pending.push_back(connection);
+  }
+  wake(loop);
+}
+
+void Reactor::stop() {
+  running_ = false;
+  for (auto &loop : loops_) {
+    wake(*loop);
+  }
+}
+
+void Reactor::join() {
+  for (auto &loop : loops_) {
+    if (loop->thread.joinable()) {
+      loop->thread.join();
+    }
+  }
+}
+
+void Reactor::wake(Loop &loop) {
+  uint64_t one = 1;
+  // EAGAIN means the counter is already non-zero, the loop will wake up anyway
+  (void) !write(loop.wake_fd, &one, sizeof(one));
+}
+
+void Reactor::runLoop(Loop &loop) {
+  epoll_event events[kMaxEvents];
+  auto last_sweep = std::chrono::steady_clock::now();
+  while (running_) {
+    int count = epoll_wait(loop.epoll_fd, events, kMaxEvents, waitTimeout(loop));
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "Reactor epoll_wait failed" << std::endl;
+      break;
+    }
+    for (int i = 0; i < count; ++i) {
+      auto *entry = static_cast<Entry *>(events[i].data.ptr);
+      if (entry == nullptr) {
+        uint64_t value;
+        (void) !read(loop.wake_fd, &value, sizeof(value));
+        registerPending(loop);
+      } else if (entry->throttled) {
+        // out of the epoll set, only hang-ups and errors are reported
+        closeConnection(loop, entry->connection->getSocket());
+      } else {
+        dispatch(loop, *entry);
+      }
+    }
+    resumeThrottled(loop);
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_sweep >= std::chrono::seconds(1)) {
+      closeIdleConnections(loop);
+      last_sweep = now;
+    }
+  }
+  // shutdown: connections still pending registration are closed as well
+  registerPending(loop);
+  for (auto &it : loop.connections) {
+    it.second->connection->clientCleanup();
+  }
+  loop.connections.clear();
+}
+
+void Reactor::registerPending(Loop &loop) {
+  std::vector<std::shared_ptr<SyslogServerThread>> pending;
+  {
+    std::lock_guard<std::mutex> lock(loop.pending_mutex);
+    pending.swap(loop.pending);
+  }
+  for (auto &connection : pending) {
+    int fd = connection->getSocket();
+    auto entry = std::make_unique<Entry>();
+    entry->connection = connection;
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.ptr = entry.get();
+    if (epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      std::cerr << "Unable to register client socket in the reactor" << std::endl;
+      connection->clientCleanup();
+      continue;
+    }
+    loop.connections[fd] = std::move(entry);
+  }
+}
+
+void Reactor::dispatch(Loop &loop, Entry &entry) {
+  entry.deficit += quantum_bytes_;
+  SyslogServerThread::IoStatus status = entry.connection->resume(entry.deficit);
+  if (status == SyslogServerThread::IoStatus::Closed) {
+    closeConnection(loop, entry.connection->getSocket());
+    return;
+  }
+  // credit left means nothing else to read, it is not saved up while idle
+  if (entry.deficit > 0)
+    entry.deficit = 0;
+  if (status == SyslogServerThread::IoStatus::Throttled) {
+    epoll_event event{};
+    event.events = 0;
+    event.data.ptr = &entry;
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_MOD, entry.connection->getSocket(), &event);
+    entry.throttled = true;
+    entry.want_write = false;
+    entry.throttled_until = std::chrono::steady_clock::now() + entry.connection->getThrottleDelay();
+    loop.throttled.push_back(entry.connection->getSocket());
+    return;
+  }
+  // OpenSSL may need the socket to become writable before the handshake can progress
+  bool want_write = status == SyslogServerThread::IoStatus::WantWrite;
+  if (want_write != entry.want_write) {
+    epoll_event event{};
+    event.events = (want_write ? EPOLLOUT : EPOLLIN) | EPOLLRDHUP;
+    event.data.ptr = &entry;
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_MOD, entry.connection->getSocket(), &event);
+    entry.want_write = want_write;
+  }
+}
+
+void Reactor::closeConnection(Loop &loop, int fd) {
+  auto it = loop.connections.find(fd);
+  if (it == loop.connections.end())
+    return;
+  epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  it->second->connection->clientCleanup();
+  loop.connections.erase(it);
+}
+
+void Reactor::closeIdleConnections(Loop &loop) {
+  auto deadline = std::chrono::steady_clock::now() - kIdleTimeout;
+  std::vector<int> idle;
+  for (const auto &it : loop.connections) {
+    // a paused client is not idle, its timeout starts over when it is resumed
+    if (!it.second->throttled && it.second->connection->getLastActivity() < deadline) {
+      idle.push_back(it.first);
+    }
+  }
+  for (int fd : idle) {
+    closeConnection(loop, fd);
+  }
+}
+
+void Reactor::resumeThrottled(Loop &loop) {
+  if (loop.throttled.empty())
+    return;
+  auto now = std::chrono::steady_clock::now();
+  auto resumed = std::remove_if(loop.throttled.begin(), loop.throttled.end(), [&](int fd) {
+    auto it = loop.connections.find(fd);
+    if (it == loop.connections.end() || !it->second->throttled)
+      return true; // closed meanwhile
+    Entry &entry = *it->second;
+    if (entry.throttled_until > now)
+      return false;
+    entry.throttled = false;
+    entry.connection->refreshActivity();
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.ptr = &entry;
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_MOD, fd, &event);
+    return true;
+  });
+  loop.throttled.erase(resumed, loop.throttled.end());
+}
+
+int Reactor::waitTimeout(const Loop &loop) {
+  int timeout = kWaitTimeoutMs;
+  auto now = std::chrono::steady_clock::now();
+  for (int fd : loop.throttled) {
+    auto it = loop.connections.find(fd);
+    if (it == loop.connections.end())
+      continue;
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(it->second->throttled_until - now).count();
+    timeout = std::min<int>(timeout, static_cast<int>(std::max<int64_t>(0, remaining)));
+  }
+  return timeout;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class SyslogServerThread;
+
+/*
+ * Event-driven alternative to one thread per client: a small fixed set of loop threads,
+ * each multiplexing its share of non-blocking client sockets through epoll.
+ * Connections are assigned round-robin and stay on the same loop until they close.
+ * Ready connections are served by deficit round robin: each round credits quantum_bytes,
+ * a connection reads until its credit is used up and keeps the overdraft for the next round,
+ * so a chatty client gets no more bandwidth than a quiet one that has as much to send.
+ * Connections over their rate limit are left out of the epoll set until their delay passed.
+ */
+class Reactor {
+ public:
+  Reactor(int threads, size_t quantum_bytes);
+  ~Reactor();
+  void start();
+  // Thread safe, the connection is registered by its loop on the next wakeup
+  void add(const std::shared_ptr<SyslogServerThread> &connection);
+  // Only signals the loops, safe to call from the shutdown handler
+  void stop();
+  void join();
+
+ private:
+  struct Entry {
+    std::shared_ptr<SyslogServerThread> connection;
+    bool want_write = false;
+    int64_t deficit = 0;
+    bool throttled = false;
+    std::chrono::steady_clock::time_point throttled_until;
+  };
+
+  struct Loop {
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    std::thread thread;
+    std::mutex pending_mutex;
+    std::vector<std::shared_ptr<SyslogServerThread>> pending;
+    // only touched by the loop thread
+    std::unordered_map<int, std::unique_ptr<Entry>> connections;
+    std::vector<int> throttled;
+  };
+
+  const int64_t quantum_bytes_;
+  std::vector<std::unique_ptr<Loop>> loops_;
+  std::atomic<size_t> next_loop_{0};
+  std::atomic<bool> running_{false};
+
+  void runLoop(Loop &loop);
+  void registerPending(Loop &loop);
+  void dispatch(Loop &loop, Entry &entry);
+  void closeConnection(Loop &loop, int fd);
+  void closeIdleConnections(Loop &loop);
+  void resumeThrottled(Loop &loop);
+  static int waitTimeout(const Loop &loop);
+  static void wake(Loop &loop);
+};
@@ -0,0 +1,145 @@
+#include "RuleEngine.h"
+
+#include <stdexcept>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "Metrics.h"
+
+namespace {
+
+inline size_t countTrailingZeros(uint64_t bits) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, bits);
+  return index;
+#else
+  return static_cast<size_t>(__builtin_ctzll(bits));
+#endif
+}
+
+}
+
+RuleEngine::RuleEngine(const std::vector<RuleConfig> &rules) : words_((rules.size() + 63) / 64) {
+  rules_.reserve(rules.size());
+  for (Bits &candidates : candidates_) {
+    candidates.assign(words_, 0);
+  }
+  for (FieldIndex &field : fields_) {
+    field.unconstrained.assign(words_, 0);
+  }
+  for (const RuleConfig &config : rules) {
+    size_t index = rules_.size();
+    Rule &rule = rules_.emplace_back();
+    rule.config = config;
+    rule.hits = &Metrics::instance().counter("rule." + config.name + ".hits");
+    if (!config.msg_regex.empty()) {
+      try {
+        rule.regex = std::make_unique<std::regex>(config.msg_regex, std::regex::ECMAScript | std::regex::optimize);
+      } catch (const std::regex_error &e) {
+        throw std::runtime_error("Invalid regular expression in rule " + config.name + ": " + e.what());
+      }
+    }
+    for (const std::string &literal : config.msg_contains) {
+      if (literal.empty())
+        continue;
+      literals_.add(literal, static_cast<uint32_t>(index));
+      rule.has_contains = true;
+    }
+    const uint64_t bit = uint64_t(1) << (index % 64);
+    for (int facility = -1; facility < static_cast<int>(kFacilities) - 1; ++facility) {
+      if (config.facility >= 0 && facility != config.facility)
+        continue;
+      for (int severity = -1; severity < static_cast<int>(kSeverities) - 1; ++severity) {
+        // messages without a valid PRI only match rules taking every severity
+        bool in_range = severity < 0 ? config.min_severity <= 0 && config.max_severity >= 7
+                                     : severity >= config.min_severity && severity <= config.max_severity;
+        if (in_range)
+          candidates_[(facility + 1) * kSeverities + (severity + 1)][index / 64] |= bit;
+      }
+    }
+  }
+  // after all rules are in place, the maps keep views of their strings
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    const RuleConfig &config = rules_[i].config;
+    indexField(Host, i, config.hosts);
+    indexField(AppName, i, config.app_names);
+    indexField(MsgId, i, config.msgids);
+    indexField(ClientIp, i, config.client_ips);
+  }
+  literals_.compile();
+}
+
+void RuleEngine::indexField(Field field, size_t rule, const std::vector<std::string> &values) {
+  FieldIndex &index = fields_[field];
+  const uint64_t bit = uint64_t(1) << (rule % 64);
+  if (values.empty()) {
+    index.unconstrained[rule / 64] |= bit;
+    return;
+  }
+  index.used = true;
+  for (const std::string &value : values) {
+    Bits &rules = index.by_value[value];
+    rules.resize(words_, 0);
+    rules[rule / 64] |= bit;
+  }
+}
+
+bool RuleEngine::isEnabled() const {
+  return !rules_.empty();
+}
+
+bool RuleEngine::hasPrefix(const RuleConfig &config, std::string_view message) {
+  if (config.msg_prefixes.empty())
+    return true;
+  for (const std::string &prefix : config.msg_prefixes) {
+    if (message.substr(0, prefix.size()) == prefix)
+      return true;
+  }
+  return false;
+}
+
+RuleEngine::Decision RuleEngine::evaluate(std::string_view frame, const SyslogHeader &header,
+                                          const std::string *client_ip) const {
+  // rules still possible, and the rules whose literals occur in the message once scanned
+  thread_local Bits live;
+  thread_local Bits found;
+  live = candidates_[(header.facility + 1) * kSeverities + (header.severity + 1)];
+  const std::array<std::string_view, kFields> values = {
+      header.hostname.in(frame), header.app_name.in(frame), header.msgid.in(frame),
+      client_ip != nullptr ? std::string_view(*client_ip) : std::string_view()};
+  for (size_t f = 0; f < kFields; ++f) {
+    const FieldIndex &field = fields_[f];
+    if (!field.used)
+      continue;
+    auto it = field.by_value.find(values[f]);
+    for (size_t w = 0; w < words_; ++w) {
+      live[w] &= field.unconstrained[w] | (it != field.by_value.end() ? it->second[w] : 0);
+    }
+  }
+  std::string_view message = header.message.in(frame);
+  bool scanned = false;
+  for (size_t w = 0; w < words_; ++w) {
+    for (uint64_t bits = live[w]; bits != 0; bits &= bits - 1) {
+      size_t index = w * 64 + countTrailingZeros(bits);
+      const Rule &rule = rules_[index];
+      if (!hasPrefix(rule.config, message))
+        continue;
+      if (rule.has_contains) {
+        if (!scanned) {
+          found.assign(words_, 0);
+          literals_.scan(message, [](uint32_t id) { found[id / 64] |= uint64_t(1) << (id % 64); });
+          scanned = true;
+        }
+        if ((found[index / 64] >> (index % 64) & 1) == 0)
+          continue;
+      }
+      if (rule.regex && !std::regex_search(message.data(), message.data() + message.size(), *rule.regex))
+        continue;
+      rule.hits->fetch_add(1, std::memory_order_relaxed);
+      return Decision{rule.config.action, rule.config.route, rule.config.severity};
+    }
+  }
+  return Decision();
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "AhoCorasick.h"
+#include "SyslogParser.h"
+
+enum class RuleAction {
+  Keep, // deliver as is and stop evaluating, for exceptions ahead of broader rules
+  Drop,
+  Route, // to the file route of the rule, see LogRouter
+  Rewrite // deliver with another severity
+};
+
+// One rule of the filter, conditions left empty match everything
+struct RuleConfig {
+  std::string name;
+  // equal to one of the values
+  std::vector<std::string> hosts;
+  std::vector<std::string> app_names;
+  std::vector<std::string> msgids;
+  std::vector<std::string> client_ips;
+  int facility = -1;
+  int min_severity = 0; // numerically, so 0 (emergency) .. 7 (debug)
+  int max_severity = 7;
+  // the message starts with / contains one of the literals
+  std::vector<std::string> msg_prefixes;
+  std::vector<std::string> msg_contains;
+  std::string msg_regex; // ECMAScript, searched anywhere in the message
+  RuleAction action = RuleAction::Keep;
+  int route = -1; // Route: index in the file routes
+  int severity = -1; // Rewrite: the new severity
+};
+
+/*
+ * First match rule list evaluated once per message before it is queued. Loading compiles it
+ * into sets of rules, as bitsets in rule order:
+ *  - a table indexed by facility and severity gives the rules that can match them
+ *  - hash maps from the values of host, app_name, msgid and client_ip give the rules
+ *    accepting each value, one lookup per field narrows the candidates down to those
+ *  - the msg_contains literals of all rules go into one Aho-Corasick automaton, scanned at
+ *    most once per message, and only when a remaining rule gets that far
+ *  - prefixes, then regular expressions run last, for the rules still left
+ * Safe to call from any client thread.
+ */
+class RuleEngine {
+ public:
+  struct Decision {
+    RuleAction action = RuleAction::Keep;
+    int route = -1;
+    int severity = -1;
+  };
+
+  explicit RuleEngine(const std::vector<RuleConfig> &rules);
+  bool isEnabled() const;
+  Decision evaluate(std::string_view frame, const SyslogHeader &header, const std::string *client_ip) const;
+
+ private:
+  using Bits = std::vector<uint64_t>;
+
+  struct Rule {
+    RuleConfig config;
+    bool has_contains = false;
+    std::unique_ptr<std::regex> regex;
+    std::atomic<uint64_t> *hits = nullptr;
+  };
+
+  // rules accepting each value of one header field
+  struct FieldIndex {
+    bool used = false;
+    Bits unconstrained; // rules without a condition on the field
+    std::unordered_map<std::string_view, Bits> by_value; // views of the strings in rules_
+  };
+
+  // facility -1..23 by severity -1..7
+  static constexpr size_t kFacilities = 25;
+  static constexpr size_t kSeverities = 9;
+  enum Field { Host, AppName, MsgId, ClientIp, kFields };
+
+  std::vector<Rule> rules_;
+  size_t words_ = 0;
+  std::array<Bits, kFacilities * kSeverities> candidates_;
+  std::array<FieldIndex, kFields> fields_;
+  AhoCorasick literals_;
+
+  void indexField(Field field, size_t rule, const std::vector<std::string> &values);
+  static bool hasPrefix(const RuleConfig &config, std::string_view message);
+};
@@ -4,8 +4,14 @@
 #include <stdexcept>
 #include <openssl/err.h>
 #ifdef OPENSSL_SYS_WINDOWS
-#include <winsock2.h>
 #include <ip2string.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/time.h>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
 #endif
 
 SSL_CTX *SSLUtil::createServerContext() {
@@ -31,18 +37,22 @@ void SSLUtil::configureContext(SSL_CTX *ctx) {
 }
 
 void SSLUtil::initWinSocket() {
+#ifdef OPENSSL_SYS_WINDOWS
   WSADATA wsaData;
   int res = WSAStartup(MAKEWORD(2, 2), &wsaData);
   if (res != NO_ERROR) {
     throw std::runtime_error("Error at WSAStartup.");
   }
+#endif
 }
 
 void SSLUtil::cleanWinSocket() {
+#ifdef OPENSSL_SYS_WINDOWS
   WSACleanup();
+#endif
 }
 
-int SSLUtil::createSocket(int port) {
+int SSLUtil::createSocket(int port, bool reusePort, int backlog) {
   int s = socket(AF_INET, SOCK_STREAM, 0);
   if (s < 0) {
     throw std::runtime_error("Unable to create socket.");
@@ -59,38 +69,102 @@ int SSLUtil::createSocket(int port) {
     throw std::runtime_error("Unable to set socket option SO_REUSEADDR.");
   }
 
+#ifdef SO_REUSEPORT
+  // several listeners on the same port, the kernel balances new connections between them
+  if (reusePort && setsockopt(s, SOL_SOCKET, SO_REUSEPORT, (char *) &optval, sizeof(optval)) < 0) {
+    throw std::runtime_error("Unable to set socket option SO_REUSEPORT.");
+  }
+#else
+  if (reusePort) {
+    throw std::runtime_error("SO_REUSEPORT is not supported on this platform.");
+  }
+#endif
+
   if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
     throw std::runtime_error("Unable to bind to socket.");
   }
 
-  if (listen(s, 1) < 0) {
+  if (listen(s, backlog) < 0) {
     throw std::runtime_error("Unable to listen to socket.");
   }
 
+  // the accept loops drain the whole queue per wakeup, until it would block
+  setNonBlocking(s, true);
+
   return s;
 }
 
+void SSLUtil::attachCpuSteering(int serverSocket, int groupSize) {
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+  // pick the listener by the CPU that handles the incoming packet: A = cpu % groupSize
+  struct sock_filter code[] = {
+      {BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<__u32>(SKF_AD_OFF + SKF_AD_CPU)},
+      {BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<__u32>(groupSize)},
+      {BPF_RET | BPF_A, 0, 0, 0},
+  };
+  struct sock_fprog program{};
+  program.len = sizeof(code) / sizeof(code[0]);
+  program.filter = code;
+  if (setsockopt(serverSocket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0) {
+    throw std::runtime_error("Unable to attach the SO_REUSEPORT CPU steering program.");
+  }
+#else
+  throw std::runtime_error("SO_REUSEPORT CPU steering is only supported on Linux.");
+#endif
+}
+
 std::string SSLUtil::getClientIP(int clientSocket) {
   struct sockaddr_in client_addr{};
-  int addr_len = sizeof(client_addr);
+  socklen_t addr_len = sizeof(client_addr);
 
   // Retrieve client information
   if (getpeername(clientSocket, (struct sockaddr *) &client_addr, &addr_len) == 0) {
     char client_ip[16];
+#ifdef OPENSSL_SYS_WINDOWS
     RtlIpv4AddressToStringA(&client_addr.sin_addr, client_ip);
+#else
+    inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
+#endif
     return std::move(std::string(client_ip));
   }
   return std::move(std::string("Unknown"));
 }
 
-int SSLUtil::acceptClient(int serverSocket) {
-  sockaddr_in addr{};
-  int len = sizeof(addr);
-  int client = accept(serverSocket, (struct sockaddr *) &addr, &len);
+bool SSLUtil::waitForClients(int serverSocket, int timeoutMs) {
+  pollfd fds{};
+  fds.fd = serverSocket;
+  fds.events = POLLIN;
+#ifdef OPENSSL_SYS_WINDOWS
+  return WSAPoll(&fds, 1, timeoutMs) > 0;
+#else
+  return poll(&fds, 1, timeoutMs) > 0;
+#endif
+}
+
+int SSLUtil::acceptClient(int serverSocket, bool nonBlocking) {
+#ifdef __linux__
+  // one syscall instead of accept + fcntl, and no descriptor leak into child processes
+  int client = accept4(serverSocket, nullptr, nullptr, SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0));
+#else
+  int client = accept(serverSocket, nullptr, nullptr);
+#endif
   if (client == INVALID_SOCKET) {
-    if (WSAGetLastError() != WSAEINTR) // the server was probably killed intentionally
+#ifdef OPENSSL_SYS_WINDOWS
+    int error = WSAGetLastError();
+    // the queue is drained, or the server was probably killed intentionally
+    if (error != WSAEWOULDBLOCK && error != WSAEINTR && error != WSAENOTSOCK)
+#else
+    // EBADF/EINVAL: the listening socket was closed by the shutdown handler
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED
+        && errno != EBADF && errno != EINVAL)
+#endif
       throw std::runtime_error("Unable to accept client.");
+    return client;
   }
+#ifndef __linux__
+  // the accepted socket inherits the non-blocking mode of the listener on Windows and BSD
+  setNonBlocking(client, nonBlocking);
+#endif
   return client;
 }
 
@@ -104,8 +178,30 @@ SSL *SSLUtil::createSSL(SSL_CTX *ctx, int clientSocket) {
   return ssl;
 }
 
+SSL *SSLUtil::createMemorySSL(SSL_CTX *ctx) {
+  SSL *ssl = SSL_new(ctx);
+  if (!ssl)
+    throw std::runtime_error("Unable to create SSL structure.");
+
+  // the caller feeds the received ciphertext and sends whatever OpenSSL writes
+  BIO *rbio = BIO_new(BIO_s_mem());
+  BIO *wbio = BIO_new(BIO_s_mem());
+  if (!rbio || !wbio) {
+    BIO_free(rbio);
+    BIO_free(wbio);
+    SSL_free(ssl);
+    throw std::runtime_error("Unable to create the SSL memory BIOs.");
+  }
+  SSL_set_bio(ssl, rbio, wbio);
+  return ssl;
+}
+
 void SSLUtil::setupClient(int clientSocket) {
+#ifdef OPENSSL_SYS_WINDOWS
   int timeout = 60000; // Timeout in milliseconds, 60 sec
+#else
+  struct timeval timeout{60, 0};
+#endif
   if (setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, (const char *) &timeout, sizeof(timeout)) < 0) {
     throw std::runtime_error("Unable to set socket option SO_RCVTIMEO.");
   }
@@ -115,3 +211,15 @@ void SSLUtil::setupClient(int clientSocket) {
     throw std::runtime_error("Unable to set socket option TCP_NODELAY.");
   }
 }
+
+void SSLUtil::setNonBlocking(int socket, bool nonBlocking) {
+#ifdef OPENSSL_SYS_WINDOWS
+  u_long mode = nonBlocking ? 1 : 0;
+  if (ioctlsocket(socket, FIONBIO, &mode) != 0) {
+#else
+  int flags = fcntl(socket, F_GETFL, 0);
+  if (flags < 0 || fcntl(socket, F_SETFL, nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK)) < 0) {
+#endif
+    throw std::runtime_error("Unable to change the socket blocking mode.");
+  }
+}
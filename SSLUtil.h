@@ -4,15 +4,34 @@
 #include <openssl/ssl.h>
 #include <string>
 
+#ifdef OPENSSL_SYS_WINDOWS
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
 class SSLUtil {
  public:
   static SSL_CTX *createServerContext();
-  static int createSocket(int port);
-  static int acceptClient(int serverSocket);
+  static int createSocket(int port, bool reusePort, int backlog);
+  static void attachCpuSteering(int serverSocket, int groupSize);
+  static bool waitForClients(int serverSocket, int timeoutMs);
+  static int acceptClient(int serverSocket, bool nonBlocking);
   static void setupClient(int clientSocket);
+  static void setNonBlocking(int socket, bool nonBlocking);
   static std::string getClientIP(int clientSocket);
   static std::string sslErrorToString(int error);
   static SSL *createSSL(SSL_CTX *ctx, int clientSocket);
+  static SSL *createMemorySSL(SSL_CTX *ctx);
   static void initWinSocket();
   static void cleanWinSocket();
 
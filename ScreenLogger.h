@@ -1,29 +1,78 @@
 #pragma once
 
-#include <iostream>
+#include <array>
+#include <cerrno>
 #include <string>
 #include <atomic>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
-#include "MemoryBoundedQueue.h"
+#include "LogRecord.h"
+#include "SeverityQueue.h"
 
+/*
+ * Prints the queued messages colored by severity. Each drained batch is rendered into one
+ * buffer and written to stdout with a single write, bypassing iostreams.
+ */
 class ScreenLogger {
  private:
-  MemoryBoundedQueue<std::string> &queue_;
+  SeverityQueue &queue_;
+  // color sequence per severity, messages without severity are printed uncolored
+  const std::array<std::string, 8> severity_colors_;
   std::atomic<bool> running_;
   std::atomic<bool> wait_;
+  static constexpr size_t kBatchItems = 1024;
+  static constexpr size_t kBatchBytes = 64 * 1024;
+  std::vector<LogRecord> batch_;
+  std::string out_;
+
+  void writeBatch() {
+    batch_.clear();
+    queue_.drainInto(batch_, kBatchItems, kBatchBytes);
+    out_.clear();
+    for (const LogRecord &record : batch_) {
+      bool colored = record.severity >= 0 && record.severity < static_cast<int>(severity_colors_.size());
+      out_ += colored ? severity_colors_[record.severity] : "\x1b[0m";
+      out_.append(record.frame.frame());
+      out_ += "\x1b[0m\n";
+    }
+    writeOut();
+  }
+
+  // the whole buffer, a failing stdout (closed pipe, full disk) loses the batch
+  void writeOut() {
+    const char *p = out_.data();
+    size_t left = out_.size();
+    while (left > 0) {
+#ifdef _WIN32
+      int written = _write(1, p, static_cast<unsigned>(left));
+#else
+      ssize_t written = ::write(STDOUT_FILENO, p, left);
+#endif
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written <= 0)
+        return;
+      p += written;
+      left -= static_cast<size_t>(written);
+    }
+  }
 
  public:
-  explicit ScreenLogger(MemoryBoundedQueue<std::string> &q) : queue_(q), running_(true), wait_(false) {}
+  ScreenLogger(SeverityQueue &q, const std::array<std::string, 8> &severity_colors)
+      : queue_(q), severity_colors_(severity_colors), running_(true), wait_(false) {}
 
   void run() {
     while (running_) {
-      std::string log = queue_.pop();
-      std::cout << log;
+      writeBatch();
     }
     if(wait_) {
       while(!queue_.empty()) {
-        std::string log = queue_.pop();
-        std::cout << log;
+        writeBatch();
       }
     }
   }
@@ -0,0 +1,81 @@
+#include "SeverityQueue.h"
+
+#include <algorithm>
+
+SeverityQueue::SeverityQueue(const std::string &name,
+                             const std::array<SeverityLaneConfig, kLanes> &lanes,
+                             OverflowPolicy policy,
+                             const std::string &spill_directory) {
+  static const std::array<const char *, kLanes> lane_names = {"urgent", "normal", "low"};
+  for (size_t i = 0; i < kLanes; ++i) {
+    lanes_[i] = std::make_unique<MemoryBoundedQueue<LogRecord>>(name + "." + lane_names[i],
+                                                                lanes[i].memory_kb * 1024,
+                                                                policy,
+                                                                spill_directory,
+                                                                64 * 1024,
+                                                                &consumer_idle_);
+    weights_[i] = std::max(1u, lanes[i].weight);
+    total_weight_ += weights_[i];
+  }
+}
+
+size_t SeverityQueue::laneOf(int severity) {
+  if (severity < 0 || severity > 5)
+    return 2;
+  return severity <= 3 ? 0 : 1;
+}
+
+void SeverityQueue::push(LogRecord record) {
+  lanes_[laneOf(record.severity)]->push(std::move(record));
+}
+
+size_t SeverityQueue::drainInto(std::vector<LogRecord> &out, size_t max_items, size_t max_bytes) {
+  while (empty()) {
+    if (shut_down_)
+      return 0;
+    waitNotEmpty();
+  }
+  size_t start = out.size();
+  size_t bytes = 0;
+  auto take = [&](size_t lane, size_t items, size_t byte_budget) {
+    size_t first = out.size();
+    lanes_[lane]->tryDrainInto(out, items, byte_budget);
+    for (size_t i = first; i < out.size(); ++i)
+      bytes += out[i].frame.memoryUsage();
+  };
+  // weighted shares first, then whatever is left of the batch in lane order
+  for (size_t lane = 0; lane < kLanes; ++lane) {
+    size_t items = std::max<size_t>(1, max_items * weights_[lane] / total_weight_);
+    size_t byte_budget = std::max<size_t>(1, max_bytes * weights_[lane] / total_weight_);
+    take(lane, std::min(items, max_items - (out.size() - start)), byte_budget);
+  }
+  for (size_t lane = 0; lane < kLanes; ++lane) {
+    size_t taken = out.size() - start;
+    if (taken >= max_items || bytes >= max_bytes)
+      break;
+    take(lane, max_items - taken, max_bytes - bytes);
+  }
+  return out.size() - start;
+}
+
+void SeverityQueue::waitNotEmpty() {
+  // same handshake as MemoryBoundedQueue::waitNotEmpty(), over all lanes
+  consumer_idle_.value.store(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!empty() || shut_down_) {
+    consumer_idle_.value.store(0);
+    return;
+  }
+  consumer_idle_.wait(1);
+}
+
+void SeverityQueue::shutdown() {
+  shut_down_ = true;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (consumer_idle_.value.exchange(0) == 1)
+    consumer_idle_.wakeOne();
+}
+
+bool SeverityQueue::empty() const {
+  return std::none_of(lanes_.begin(), lanes_.end(), [](const auto &lane) { return lane->hasPending(); });
+}
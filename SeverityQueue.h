@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Config.h"
+#include "Futex.h"
+#include "LogRecord.h"
+#include "MemoryBoundedQueue.h"
+
+/*
+ * Sink queue split into severity lanes, each a MemoryBoundedQueue with its own memory
+ * budget: urgent (emergency..error), normal (warning, notice) and low (info, debug and
+ * unparsable frames). A batch takes from every lane in proportion to its weight, most
+ * severe first, then fills up in lane order, so a debug storm neither delays errors by
+ * more than one batch nor evicts them, while the low lane is never starved.
+ * Messages keep their order within a lane only.
+ */
+class SeverityQueue {
+ public:
+  static constexpr size_t kLanes = 3;
+
+  SeverityQueue(const std::string &name,
+                const std::array<SeverityLaneConfig, kLanes> &lanes,
+                OverflowPolicy policy,
+                const std::string &spill_directory);
+  SeverityQueue(const SeverityQueue &) = delete;
+  SeverityQueue &operator=(const SeverityQueue &) = delete;
+
+  // Safe from any thread
+  void push(LogRecord record);
+  // Consumer only, same contract as MemoryBoundedQueue::drainInto()
+  size_t drainInto(std::vector<LogRecord> &out, size_t max_items, size_t max_bytes);
+  // Wakes the consumer for good, pending records can still be drained
+  void shutdown();
+  bool empty() const;
+
+ private:
+  // all lanes wake the consumer through this one
+  Futex consumer_idle_;
+  std::atomic<bool> shut_down_{false};
+  std::array<std::unique_ptr<MemoryBoundedQueue<LogRecord>>, kLanes> lanes_;
+  std::array<unsigned, kLanes> weights_{};
+  unsigned total_weight_ = 0;
+
+  static size_t laneOf(int severity);
+  void waitNotEmpty();
+};
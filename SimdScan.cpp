@@ -0,0 +1,165 @@
+#include "SimdScan.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define SIMDSCAN_SSE2
+#include <immintrin.h>
+#endif
+#if defined(SIMDSCAN_SSE2) && (defined(__GNUC__) || defined(__clang__))
+// compiled for AVX2 regardless of the global flags, only called when the CPU has it
+#define SIMDSCAN_AVX2 __attribute__((target("avx2")))
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+inline unsigned countTrailingZeros(unsigned mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+const char *findByteScalar(const char *begin, const char *end, char needle) {
+  return static_cast<const char *>(std::memchr(begin, needle, static_cast<size_t>(end - begin)));
+}
+
+const char *findJsonSpecialScalar(const char *begin, const char *end) {
+  for (const char *p = begin; p < end; ++p) {
+    auto c = static_cast<unsigned char>(*p);
+    if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\')
+      return p;
+  }
+  return end;
+}
+
+#ifdef SIMDSCAN_SSE2
+const char *findByteSse2(const char *begin, const char *end, char needle) {
+  const __m128i pattern = _mm_set1_epi8(needle);
+  const char *p = begin;
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pattern)));
+    if (mask != 0)
+      return p + countTrailingZeros(mask);
+  }
+  return findByteScalar(p, end, needle);
+}
+#endif
+
+#ifdef SIMDSCAN_SSE2
+const char *findJsonSpecialSse2(const char *begin, const char *end) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i last_control = _mm_set1_epi8(0x1f);
+  const char *p = begin;
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    // unsigned c <= 0x1f is max(c, 0x1f) == 0x1f; bytes from 0x80 on have their sign bit set
+    __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                   _mm_cmpeq_epi8(_mm_max_epu8(chunk, last_control), last_control));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(special, chunk)));
+    if (mask != 0)
+      return p + countTrailingZeros(mask);
+  }
+  return findJsonSpecialScalar(p, end);
+}
+#endif
+
+#ifdef SIMDSCAN_AVX2
+SIMDSCAN_AVX2 const char *findJsonSpecialAvx2(const char *begin, const char *end) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i last_control = _mm256_set1_epi8(0x1f);
+  const char *p = begin;
+  for (; end - p >= 32; p += 32) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i special = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+        _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, last_control), last_control));
+    auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(special, chunk)));
+    if (mask != 0)
+      return p + countTrailingZeros(mask);
+  }
+  return findJsonSpecialSse2(p, end);
+}
+#endif
+
+#ifdef SIMDSCAN_AVX2
+SIMDSCAN_AVX2 const char *findByteAvx2(const char *begin, const char *end, char needle) {
+  const __m256i pattern = _mm256_set1_epi8(needle);
+  const char *p = begin;
+  // two vectors per iteration, most 16 KB reads hold only a few hundred lines
+  for (; end - p >= 64; p += 64) {
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+    __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(low, pattern), _mm256_cmpeq_epi8(high, pattern));
+    if (_mm256_movemask_epi8(hits) != 0) {
+      auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, pattern)));
+      if (mask != 0)
+        return p + countTrailingZeros(mask);
+      mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, pattern)));
+      return p + 32 + countTrailingZeros(mask);
+    }
+  }
+  for (; end - p >= 32; p += 32) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, pattern)));
+    if (mask != 0)
+      return p + countTrailingZeros(mask);
+  }
+  return findByteSse2(p, end, needle);
+}
+#endif
+
+using FindByte = const char *(*)(const char *, const char *, char);
+
+FindByte selectFindByte() {
+#ifdef SIMDSCAN_AVX2
+  if (__builtin_cpu_supports("avx2"))
+    return findByteAvx2;
+#endif
+#ifdef SIMDSCAN_SSE2
+  return findByteSse2;
+#else
+  return findByteScalar;
+#endif
+}
+
+const FindByte find_byte = selectFindByte();
+
+using FindJsonSpecial = const char *(*)(const char *, const char *);
+
+FindJsonSpecial selectFindJsonSpecial() {
+#ifdef SIMDSCAN_AVX2
+  if (__builtin_cpu_supports("avx2"))
+    return findJsonSpecialAvx2;
+#endif
+#ifdef SIMDSCAN_SSE2
+  return findJsonSpecialSse2;
+#else
+  return findJsonSpecialScalar;
+#endif
+}
+
+const FindJsonSpecial find_json_special = selectFindJsonSpecial();
+
+}
+
+namespace SimdScan {
+
+const char *findByte(const char *begin, const char *end, char needle) {
+  return find_byte(begin, end, needle);
+}
+
+const char *findJsonSpecial(const char *begin, const char *end) {
+  return find_json_special(begin, end);
+}
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+/*
+ * Vectorized byte scanners for the parsing hot paths. The AVX2 variants are picked at
+ * runtime when the CPU supports them, SSE2 is the baseline on x86-64, other targets
+ * fall back to scalar code.
+ */
+namespace SimdScan {
+
+// First occurrence of needle in [begin, end), nullptr if there is none
+const char *findByte(const char *begin, const char *end, char needle);
+
+// First byte in [begin, end) a JSON string cannot take as is: '"', '\\', control characters
+// and, to have UTF-8 checked, bytes of 0x80 and above; end if there is none
+const char *findJsonSpecial(const char *begin, const char *end);
+
+}
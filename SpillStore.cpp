@@ -0,0 +1,211 @@
+#include "SpillStore.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+SpillStore::SpillStore(const std::string &directory, const std::string &name) : directory_(directory), name_(name) {
+  std::error_code error;
+  std::filesystem::create_directories(directory_, error);
+  if (error) {
+    throw std::runtime_error("Unable to create spill directory " + directory_ + ": " + error.message());
+  }
+  // segments of a previous run are replayed first
+  std::vector<uint64_t> segments;
+  const std::string prefix = name_ + "-";
+  for (const auto &entry : std::filesystem::directory_iterator(directory_)) {
+    std::string file = entry.path().filename().string();
+    if (file.compare(0, prefix.size(), prefix) != 0 || entry.path().extension() != ".spill")
+      continue;
+    try {
+      segments.push_back(std::stoull(file.substr(prefix.size())));
+      pending_bytes_ += entry.file_size();
+    } catch (const std::exception &) {
+      // not one of ours
+    }
+  }
+  if (!segments.empty()) {
+    std::sort(segments.begin(), segments.end());
+    read_segment_ = segments.front();
+    write_segment_ = segments.back() + 1;
+    std::cout << "Replaying " << segments.size() << " spilled segment(s) of the " << name_ << " queue" << std::endl;
+  }
+  writer_thread_ = std::thread(&SpillStore::runWriter, this);
+}
+
+SpillStore::~SpillStore() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  wakeup_.notify_one();
+  writer_thread_.join();
+}
+
+std::string SpillStore::segmentPath(uint64_t segment) const {
+  return (std::filesystem::path(directory_) / (name_ + "-" + std::to_string(segment) + ".spill")).string();
+}
+
+bool SpillStore::append(std::string_view record) {
+  auto length = static_cast<uint32_t>(record.size());
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (full_buffers_.size() >= kMaxQueuedBuffers)
+    return false;
+  write_buffer_.append(reinterpret_cast<const char *>(&length), sizeof(length));
+  write_buffer_.append(record);
+  pending_bytes_ += sizeof(length) + record.size();
+  if (write_buffer_.size() >= kWriteBufferBytes) {
+    full_buffers_.push_back(std::move(write_buffer_));
+    write_buffer_.clear();
+    wakeup_.notify_one();
+  }
+  return true;
+}
+
+void SpillStore::runWriter() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    wakeup_.wait(lock, [this] { return stopped_ || !full_buffers_.empty(); });
+    if (stopped_ && !write_buffer_.empty()) {
+      full_buffers_.push_back(std::move(write_buffer_));
+      write_buffer_.clear();
+    }
+    if (full_buffers_.empty())
+      return;
+    std::string buffer = std::move(full_buffers_.front());
+    full_buffers_.pop_front();
+    writing_ = true;
+    lock.unlock();
+    writeBuffer(buffer);
+    lock.lock();
+    written_bytes_ += buffer.size();
+    if (written_bytes_ >= kSegmentBytes) {
+      writer_.close();
+      ++write_segment_;
+      written_bytes_ = 0;
+    }
+    writing_ = false;
+    written_.notify_all();
+  }
+}
+
+void SpillStore::writeBuffer(const std::string &buffer) {
+  // write_segment_ only changes under the lock with no buffer being written
+  std::string path = segmentPath(write_segment_);
+  if (!writer_.is_open()) {
+    writer_.open(path, std::ios::binary | std::ios::app);
+  }
+  writer_.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+  writer_.flush();
+  if (!writer_) {
+    std::cerr << "Unable to write spill segment " << path << std::endl;
+    writer_.clear();
+  }
+}
+
+bool SpillStore::waitWritten(std::unique_lock<std::mutex> &lock) {
+  if (write_buffer_.empty() && full_buffers_.empty() && !writing_)
+    return true;
+  // the rest of the records is still in memory, it goes through the segment to stay in order
+  if (!write_buffer_.empty()) {
+    full_buffers_.push_back(std::move(write_buffer_));
+    write_buffer_.clear();
+    wakeup_.notify_one();
+  }
+  written_.wait(lock, [this] { return full_buffers_.empty() && !writing_; });
+  return false;
+}
+
+bool SpillStore::openReader() {
+  reader_.open(segmentPath(read_segment_), std::ios::binary);
+  if (!reader_.is_open())
+    return false;
+  reader_.seekg(static_cast<std::streamoff>(read_offset_));
+  return true;
+}
+
+bool SpillStore::read(std::string &record) {
+  for (;;) {
+    uint64_t write_segment;
+    uint64_t written_bytes;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      write_segment = write_segment_;
+      written_bytes = written_bytes_;
+    }
+    bool last_segment = read_segment_ == write_segment;
+    if (last_segment && read_offset_ >= written_bytes) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!waitWritten(lock) || read_segment_ != write_segment_ || read_offset_ < written_bytes_)
+        continue;
+      startOver();
+      return false;
+    }
+    if (!reader_.is_open() && !openReader()) {
+      if (last_segment)
+        return false;
+      // lost segment, move on
+      ++read_segment_;
+      read_offset_ = 0;
+      continue;
+    }
+    uint32_t length = 0;
+    if (!reader_.read(reinterpret_cast<char *>(&length), sizeof(length)) && last_segment) {
+      // the buffered reader hit the end before the latest append, look again
+      reader_.clear();
+      reader_.seekg(static_cast<std::streamoff>(read_offset_));
+      reader_.read(reinterpret_cast<char *>(&length), sizeof(length));
+    }
+    if (reader_) {
+      record.resize(length);
+      reader_.read(record.data(), length);
+    }
+    if (reader_) {
+      read_offset_ += sizeof(length) + length;
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_bytes_ -= std::min<uint64_t>(pending_bytes_, sizeof(length) + length);
+      return true;
+    }
+    if (last_segment) {
+      std::cerr << "Corrupt spill segment " << segmentPath(read_segment_) << std::endl;
+      read_offset_ = written_bytes;
+      reader_.close();
+      continue;
+    }
+    // end of a segment that will not grow anymore
+    reader_.close();
+    std::filesystem::remove(segmentPath(read_segment_));
+    ++read_segment_;
+    read_offset_ = 0;
+  }
+}
+
+void SpillStore::startOver() {
+  // drained, start over with an empty segment instead of growing this one forever, and
+  // without leaving read records behind for the next run to replay
+  if (written_bytes_ > 0) {
+    reader_.close();
+    writer_.close();
+    std::filesystem::remove(segmentPath(read_segment_));
+    read_segment_ = ++write_segment_;
+    written_bytes_ = 0;
+    read_offset_ = 0;
+  }
+  pending_bytes_ = 0;
+}
+
+bool SpillStore::empty() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (read_segment_ != write_segment_ || read_offset_ < written_bytes_ || !write_buffer_.empty()
+      || !full_buffers_.empty() || writing_)
+    return false;
+  startOver();
+  return true;
+}
+
+uint64_t SpillStore::pendingBytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_bytes_;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/*
+ * FIFO of opaque records in append-only segment files "<directory>/<name>-<index>.spill",
+ * written and read sequentially. Records are length prefixed and collected in 1 MB buffers
+ * that a background thread appends to the segment, so append() never touches the disk; a
+ * segment is deleted as soon as it has been read, and read segments left over by a previous
+ * run come first. append() is safe from any thread, read() and empty() are for a single
+ * consumer, which reads the files without holding the lock append() takes.
+ */
+class SpillStore {
+ public:
+  SpillStore(const std::string &directory, const std::string &name);
+  // Writes out what is still buffered
+  ~SpillStore();
+  SpillStore(const SpillStore &) = delete;
+  SpillStore &operator=(const SpillStore &) = delete;
+
+  // False when the record was dropped, the writer being too far behind
+  bool append(std::string_view record);
+  // Oldest record, false when the store is empty
+  bool read(std::string &record);
+  // True once every record was read, the segment read is then removed
+  bool empty();
+  // Bytes appended but not read yet
+  uint64_t pendingBytes();
+
+ private:
+  static constexpr uint64_t kSegmentBytes = 64 * 1024 * 1024;
+  static constexpr size_t kWriteBufferBytes = 1024 * 1024;
+  // buffers waiting for the writer, beyond that records are dropped rather than held in memory
+  static constexpr size_t kMaxQueuedBuffers = 64;
+
+  const std::string directory_;
+  const std::string name_;
+  std::mutex mutex_;
+  std::condition_variable wakeup_; // the writer: a buffer is ready or stopping
+  std::condition_variable written_; // the reader: the writer is done with its buffers
+  std::string write_buffer_;
+  std::deque<std::string> full_buffers_;
+  bool writing_ = false; // the writer holds a buffer, only then it touches writer_
+  bool stopped_ = false;
+  uint64_t write_segment_ = 0;
+  uint64_t written_bytes_ = 0; // in the segment being written
+  uint64_t pending_bytes_ = 0;
+  std::ofstream writer_;
+  std::thread writer_thread_;
+  // consumer only
+  std::ifstream reader_;
+  uint64_t read_segment_ = 0;
+  uint64_t read_offset_ = 0;
+
+  std::string segmentPath(uint64_t segment) const;
+  bool openReader();
+  void runWriter();
+  void writeBuffer(const std::string &buffer);
+  // the consumer reached the end of the files, true once all buffered records are written too
+  bool waitWritten(std::unique_lock<std::mutex> &lock);
+  // with the lock held, everything read
+  void startOver();
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "SimdScan.h"
+
+/*
+ * Incremental RFC 6587 parser for both TCP framings, cutting frames out of the decrypted
+ * stream in place, however the reads split them. A read may hold any number of frames,
+ * and a frame may span several reads; only a frame straddling a read boundary is copied,
+ * into a buffer reused between frames.
+ *  - octet counting: "MSG-LEN SP SYSLOG-MSG"
+ *  - non-transparent: "SYSLOG-MSG LF", the trailer is searched with SIMD
+ * In auto mode the first byte of the connection decides: a digit starts a length prefix,
+ * anything else (normally the '<' of the PRI) a non-transparent frame.
+ */
+class SyslogFramer {
+ public:
+  enum class Mode { Auto, OctetCounting, NonTransparent };
+
+  // larger frames are treated as garbage, the length prefix was probably not one
+  static constexpr size_t kMaxFrameLength = 16 * 1024 * 1024;
+
+  explicit SyslogFramer(Mode mode = Mode::Auto) : mode_(mode) {}
+
+  Mode getMode() const { return mode_; }
+
+  /*
+   * Calls on_frame(std::string_view) for every complete frame in data. The views are
+   * only valid during the call. Returns false on a malformed stream, which cannot be
+   * resynchronized: the connection should be dropped.
+   */
+  template<typename F>
+  bool feed(const char *data, size_t len, F &&on_frame) {
+    if (mode_ == Mode::Auto) {
+      size_t pos = 0;
+      while (pos < len && (data[pos] == '\n' || data[pos] == '\r'))
+        ++pos;
+      if (pos == len)
+        return true;
+      mode_ = data[pos] >= '0' && data[pos] <= '9' ? Mode::OctetCounting : Mode::NonTransparent;
+    }
+    if (mode_ == Mode::NonTransparent)
+      return feedNonTransparent(data, len, on_frame);
+    return feedOctetCounting(data, len, on_frame);
+  }
+
+ private:
+  enum class State { Length, Payload };
+
+  Mode mode_;
+  State state_ = State::Length;
+  size_t frame_length_ = 0;
+  int length_digits_ = 0;
+  std::string partial_;
+
+  void reset() {
+    state_ = State::Length;
+    frame_length_ = 0;
+    length_digits_ = 0;
+    partial_.clear();
+  }
+
+  template<typename F>
+  bool feedOctetCounting(const char *data, size_t len, F &on_frame) {
+    size_t pos = 0;
+    while (pos < len) {
+      if (state_ == State::Length) {
+        char c = data[pos++];
+        if (c >= '0' && c <= '9') {
+          frame_length_ = frame_length_ * 10 + static_cast<size_t>(c - '0');
+          if (frame_length_ > kMaxFrameLength)
+            return false;
+          ++length_digits_;
+        } else if (c == ' ' && length_digits_ > 0) {
+          state_ = State::Payload;
+          if (frame_length_ == 0)
+            reset();
+        } else if (length_digits_ > 0 || (c != '\n' && c != '\r')) {
+          // some senders terminate octet counted frames with a newline anyway
+          return false;
+        }
+        continue;
+      }
+      size_t available = len - pos;
+      if (partial_.empty() && available >= frame_length_) {
+        // fast path: the whole frame is in this read
+        on_frame(std::string_view(data + pos, frame_length_));
+        pos += frame_length_;
+        reset();
+        continue;
+      }
+      size_t needed = frame_length_ - partial_.size();
+      size_t taken = available < needed ? available : needed;
+      partial_.append(data + pos, taken);
+      pos += taken;
+      if (partial_.size() == frame_length_) {
+        on_frame(std::string_view(partial_));
+        reset();
+      }
+    }
+    return true;
+  }
+
+  template<typename F>
+  bool feedNonTransparent(const char *data, size_t len, F &on_frame) {
+    const char *pos = data;
+    const char *end = data + len;
+    while (pos < end) {
+      const char *lf = SimdScan::findByte(pos, end, '\n');
+      if (lf == nullptr) {
+        if (partial_.size() + static_cast<size_t>(end - pos) > kMaxFrameLength)
+          return false;
+        partial_.append(pos, end);
+        break;
+      }
+      if (partial_.empty()) {
+        emitLine(std::string_view(pos, static_cast<size_t>(lf - pos)), on_frame);
+      } else {
+        partial_.append(pos, lf);
+        emitLine(std::string_view(partial_), on_frame);
+        partial_.clear();
+      }
+      pos = lf + 1;
+    }
+    return true;
+  }
+
+  template<typename F>
+  static void emitLine(std::string_view line, F &on_frame) {
+    // CRLF senders, and blank keepalive lines
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    if (!line.empty())
+      on_frame(line);
+  }
+};
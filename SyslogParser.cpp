@@ -0,0 +1,340 @@
+#include "SyslogParser.h"
+
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+inline bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+SyslogHeader::Span makeSpan(size_t begin, size_t end) {
+  SyslogHeader::Span span;
+  span.offset = static_cast<uint32_t>(begin);
+  span.length = static_cast<uint32_t>(end - begin);
+  return span;
+}
+
+const char *const kFacilityNames[] = {
+    "kern", "user", "mail", "daemon", "auth", "syslog", "lpr", "news", "uucp", "cron", "authpriv", "ftp",
+    "ntp", "audit", "alert", "clock", "local0", "local1", "local2", "local3", "local4", "local5", "local6", "local7"};
+const char *const kSeverityNames[] = {"emerg", "alert", "crit", "err", "warning", "notice", "info", "debug"};
+
+// value of n digits, -1 when one of them is not a digit
+int parseDigits(const char *p, int n) {
+  int value = 0;
+  for (int i = 0; i < n; ++i) {
+    if (!isDigit(p[i]))
+      return -1;
+    value = value * 10 + (p[i] - '0');
+  }
+  return value;
+}
+
+// days since 1970-01-01 of a proleptic Gregorian date, see H. Hinnant's chrono algorithms
+int64_t daysFromCivil(int year, int month, int day) {
+  year -= month <= 2;
+  const int64_t era = (year >= 0 ? year : year - 399) / 400;
+  const int64_t year_of_era = year - era * 400;
+  const int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  const int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  return era * 146097 + day_of_era - 719468;
+}
+
+int monthFromName(const char *p) {
+  static const char names[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  for (int month = 0; month < 12; ++month) {
+    if (std::memcmp(names + month * 3, p, 3) == 0)
+      return month + 1;
+  }
+  return -1;
+}
+
+// "Mmm dd hh:mm:ss", the day is space padded
+bool isBsdTimestamp(const char *p) {
+  return p[0] >= 'A' && p[0] <= 'Z' && p[1] >= 'a' && p[1] <= 'z' && p[2] >= 'a' && p[2] <= 'z' && p[3] == ' '
+      && (p[4] == ' ' || isDigit(p[4])) && isDigit(p[5]) && p[6] == ' ' && isDigit(p[7]) && isDigit(p[8])
+      && p[9] == ':' && isDigit(p[10]) && isDigit(p[11]) && p[12] == ':' && isDigit(p[13]) && isDigit(p[14]);
+}
+
+// RFC 5424 header field ending with a space, NILVALUE becomes an empty span
+bool nextField(std::string_view frame, size_t &pos, SyslogHeader::Span &span) {
+  size_t end = frame.find(' ', pos);
+  if (end == std::string_view::npos || end == pos)
+    return false;
+  if (end - pos != 1 || frame[pos] != '-')
+    span = makeSpan(pos, end);
+  pos = end + 1;
+  return true;
+}
+
+}
+
+const char *SyslogHeader::facilityName(int facility) {
+  return facility >= 0 && facility < 24 ? kFacilityNames[facility] : nullptr;
+}
+
+const char *SyslogHeader::severityName(int severity) {
+  return severity >= 0 && severity < 8 ? kSeverityNames[severity] : nullptr;
+}
+
+int SyslogHeader::facilityCode(const std::string &name) {
+  for (int facility = 0; facility < 24; ++facility) {
+    if (name == kFacilityNames[facility])
+      return facility;
+  }
+  return -1;
+}
+
+int SyslogHeader::severityCode(const std::string &name) {
+  for (int severity = 0; severity < 8; ++severity) {
+    if (name == kSeverityNames[severity])
+      return severity;
+  }
+  return -1;
+}
+
+SyslogHeader SyslogParser::parse(std::string_view frame) {
+  SyslogHeader header;
+  size_t pos = parsePriority(frame, header);
+  if (pos != 0 && parseRfc5424(frame, pos, header))
+    return header;
+  parseRfc3164(frame, pos, header);
+  return header;
+}
+
+size_t SyslogParser::parsePriority(std::string_view frame, SyslogHeader &header) {
+  // "<PRI>" with PRI = facility * 8 + severity, at most 191
+  if (frame.size() < 3 || frame[0] != '<')
+    return 0;
+  int priority = 0;
+  size_t i = 1;
+  for (; i < frame.size() && i <= 3 && isDigit(frame[i]); ++i) {
+    priority = priority * 10 + (frame[i] - '0');
+  }
+  if (i == 1 || i >= frame.size() || frame[i] != '>' || priority > 191)
+    return 0;
+  header.facility = priority / 8;
+  header.severity = priority % 8;
+  return i + 1;
+}
+
+bool SyslogParser::parseRfc5424(std::string_view frame, size_t pos, SyslogHeader &header) {
+  // VERSION SP TIMESTAMP SP HOSTNAME SP APP-NAME SP PROCID SP MSGID SP STRUCTURED-DATA [SP MSG]
+  if (pos + 1 >= frame.size() || frame[pos] < '1' || frame[pos] > '9')
+    return false;
+  int version = frame[pos++] - '0';
+  if (isDigit(frame[pos]))
+    version = version * 10 + (frame[pos++] - '0');
+  if (pos >= frame.size() || frame[pos++] != ' ')
+    return false;
+
+  SyslogHeader parsed = header;
+  if (!nextField(frame, pos, parsed.timestamp) || !nextField(frame, pos, parsed.hostname)
+      || !nextField(frame, pos, parsed.app_name) || !nextField(frame, pos, parsed.procid)
+      || !nextField(frame, pos, parsed.msgid) || pos >= frame.size())
+    return false;
+  if (frame[pos] == '-') {
+    ++pos;
+  } else if (frame[pos] == '[') {
+    size_t end = skipStructuredData(frame, pos);
+    if (end == 0)
+      return false;
+    parsed.structured_data = makeSpan(pos, end);
+    pos = end;
+  } else {
+    return false;
+  }
+  if (pos < frame.size()) {
+    if (frame[pos] != ' ')
+      return false;
+    parsed.message = makeSpan(pos + 1, frame.size());
+  }
+  parsed.format = SyslogHeader::Format::Rfc5424;
+  parsed.version = version;
+  header = parsed;
+  return true;
+}
+
+size_t SyslogParser::skipStructuredData(std::string_view frame, size_t pos) {
+  // one or more "[id param="value" ...]" elements, values may escape '"', '\' and ']'
+  while (pos < frame.size() && frame[pos] == '[') {
+    bool quoted = false;
+    for (++pos; pos < frame.size(); ++pos) {
+      char c = frame[pos];
+      if (quoted) {
+        if (c == '\\')
+          ++pos;
+        else if (c == '"')
+          quoted = false;
+      } else if (c == '"') {
+        quoted = true;
+      } else if (c == ']') {
+        break;
+      }
+    }
+    if (pos >= frame.size())
+      return 0;
+    ++pos;
+  }
+  return pos;
+}
+
+void SyslogParser::parseRfc3164(std::string_view frame, size_t pos, SyslogHeader &header) {
+  header.format = SyslogHeader::Format::Rfc3164;
+  size_t size = frame.size();
+  if (size - pos >= 16 && frame[pos + 15] == ' ' && isBsdTimestamp(frame.data() + pos)) {
+    header.timestamp = makeSpan(pos, pos + 15);
+    pos += 16;
+  } else if (size - pos >= 11 && isDigit(frame[pos]) && isDigit(frame[pos + 3]) && frame[pos + 4] == '-') {
+    // ISO 8601 timestamps sent by newer BSD style senders
+    size_t end = frame.find(' ', pos);
+    if (end == std::string_view::npos)
+      end = size;
+    header.timestamp = makeSpan(pos, end);
+    pos = end < size ? end + 1 : size;
+  } else {
+    // without a timestamp there is no telling a hostname from the message
+    header.message = makeSpan(pos, size);
+    return;
+  }
+
+  // HOSTNAME is optional: the first word is the TAG already when it ends with ':' or has a [PID]
+  size_t word_end = frame.find(' ', pos);
+  if (word_end == std::string_view::npos)
+    word_end = size;
+  std::string_view word = frame.substr(pos, word_end - pos);
+  bool is_tag = !word.empty() && (word.back() == ':' || word.find('[') != std::string_view::npos);
+  if (!is_tag && word_end < size) {
+    header.hostname = makeSpan(pos, word_end);
+    pos = word_end + 1;
+  }
+
+  // TAG[PID]: MSG
+  size_t tag_end = pos;
+  while (tag_end < size && frame[tag_end] != '[' && frame[tag_end] != ':' && frame[tag_end] != ' ')
+    ++tag_end;
+  size_t msg = tag_end;
+  if (tag_end < size && frame[tag_end] == '[') {
+    size_t pid_end = frame.find(']', tag_end);
+    if (pid_end != std::string_view::npos) {
+      header.procid = makeSpan(tag_end + 1, pid_end);
+      msg = pid_end + 1;
+    }
+  }
+  if (msg < size && frame[msg] == ':') {
+    header.app_name = makeSpan(pos, tag_end);
+    ++msg;
+    if (msg < size && frame[msg] == ' ')
+      ++msg;
+  } else if (!header.procid.empty()) {
+    header.app_name = makeSpan(pos, tag_end);
+    if (msg < size && frame[msg] == ' ')
+      ++msg;
+  } else {
+    // no recognizable tag, the rest is the message
+    msg = pos;
+  }
+  header.message = makeSpan(msg, size);
+}
+
+int64_t TimestampParser::parse(std::string_view timestamp) {
+  if (timestamp.size() >= 20 && isDigit(timestamp[0]))
+    return parseRfc3339(timestamp);
+  if (timestamp.size() == 15 && isBsdTimestamp(timestamp.data()))
+    return parseBsd(timestamp);
+  return -1;
+}
+
+bool TimestampParser::cached(std::string_view prefix) const {
+  return prefix.size() == prefix_length_ && std::memcmp(prefix.data(), prefix_.data(), prefix_length_) == 0;
+}
+
+void TimestampParser::remember(std::string_view prefix, int64_t epoch_sec) {
+  std::memcpy(prefix_.data(), prefix.data(), prefix.size());
+  prefix_length_ = prefix.size();
+  prefix_epoch_sec_ = epoch_sec;
+}
+
+int64_t TimestampParser::parseRfc3339(std::string_view timestamp) {
+  // YYYY-MM-DDTHH:MM:SS[.F{1,9}](Z|+HH:MM|-HH:MM)
+  const char *p = timestamp.data();
+  std::string_view prefix = timestamp.substr(0, 13);
+  if (!cached(prefix)) {
+    int year = parseDigits(p, 4);
+    int month = parseDigits(p + 5, 2);
+    int day = parseDigits(p + 8, 2);
+    int hour = parseDigits(p + 11, 2);
+    if (year < 0 || p[4] != '-' || month < 1 || month > 12 || p[7] != '-' || day < 1 || day > 31
+        || (p[10] != 'T' && p[10] != 't') || hour < 0 || hour > 23)
+      return -1;
+    remember(prefix, daysFromCivil(year, month, day) * 86400 + hour * 3600);
+  }
+  int minute = parseDigits(p + 14, 2);
+  int second = parseDigits(p + 17, 2);
+  if (p[13] != ':' || minute < 0 || minute > 59 || p[16] != ':' || second < 0 || second > 60)
+    return -1;
+
+  size_t pos = 19;
+  int64_t nanos = 0;
+  if (timestamp[pos] == '.') {
+    int64_t scale = 100000000;
+    for (++pos; pos < timestamp.size() && isDigit(timestamp[pos]); ++pos, scale /= 10) {
+      nanos += (timestamp[pos] - '0') * scale;
+    }
+  }
+  int64_t offset_sec = 0;
+  if (pos < timestamp.size() && (timestamp[pos] == 'Z' || timestamp[pos] == 'z')) {
+    ++pos;
+  } else if (pos + 6 == timestamp.size() && (timestamp[pos] == '+' || timestamp[pos] == '-')) {
+    int offset_hour = parseDigits(p + pos + 1, 2);
+    int offset_minute = parseDigits(p + pos + 4, 2);
+    if (offset_hour < 0 || timestamp[pos + 3] != ':' || offset_minute < 0)
+      return -1;
+    offset_sec = (offset_hour * 3600 + offset_minute * 60) * (timestamp[pos] == '+' ? 1 : -1);
+    pos += 6;
+  }
+  if (pos != timestamp.size())
+    return -1;
+  return (prefix_epoch_sec_ + minute * 60 + second - offset_sec) * 1000000000 + nanos;
+}
+
+int64_t TimestampParser::parseBsd(std::string_view timestamp) {
+  // Mmm dd hh:mm:ss
+  const char *p = timestamp.data();
+  std::string_view prefix = timestamp.substr(0, 9);
+  if (!cached(prefix)) {
+    int month = monthFromName(p);
+    int day = (p[4] == ' ' ? 0 : p[4] - '0') * 10 + (p[5] - '0');
+    int hour = parseDigits(p + 7, 2);
+    if (month < 0 || day < 1 || day > 31 || hour > 23)
+      return -1;
+    time_t now = time(nullptr);
+    struct tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    // a December message received in January is from last year
+    int year = local.tm_year;
+    if (month - 1 > local.tm_mon + 1)
+      --year;
+    struct tm stamp{};
+    stamp.tm_year = year;
+    stamp.tm_mon = month - 1;
+    stamp.tm_mday = day;
+    stamp.tm_hour = hour;
+    stamp.tm_isdst = -1;
+    time_t epoch = mktime(&stamp);
+    if (epoch == -1)
+      return -1;
+    remember(prefix, static_cast<int64_t>(epoch));
+  }
+  int minute = parseDigits(p + 10, 2);
+  int second = parseDigits(p + 13, 2);
+  if (minute > 59 || second > 60)
+    return -1;
+  return (prefix_epoch_sec_ + minute * 60 + second) * 1000000000;
+}
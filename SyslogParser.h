@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ * Header fields of one syslog message, as offsets into its frame so parsing never
+ * allocates. Absent and NILVALUE ("-") fields are empty spans.
+ */
+struct SyslogHeader {
+  enum class Format { Unknown, Rfc5424, Rfc3164 };
+
+  struct Span {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+
+    bool empty() const { return length == 0; }
+    std::string_view in(std::string_view frame) const { return frame.substr(offset, length); }
+  };
+
+  Format format = Format::Unknown;
+  int facility = -1; // -1 without a valid PRI
+  int severity = -1;
+  int version = 0; // 0 for RFC 3164
+  Span timestamp;
+  Span hostname;
+  Span app_name; // the TAG of RFC 3164
+  Span procid;
+  Span msgid;
+  Span structured_data; // including the brackets
+  Span message;
+
+  // Lower case names as in syslog.conf ("local0", "warning"), nullptr when out of range
+  static const char *facilityName(int facility);
+  static const char *severityName(int severity);
+  // -1 for unknown names
+  static int facilityCode(const std::string &name);
+  static int severityCode(const std::string &name);
+};
+
+/*
+ * Single pass parser for RFC 5424 headers, falling back to the loose RFC 3164 (BSD)
+ * layout "<PRI>Mmm dd hh:mm:ss HOSTNAME TAG[PID]: MSG" and its common variants, i.e. no
+ * hostname or an ISO timestamp. Anything unrecognized ends up in the message span.
+ */
+class SyslogParser {
+ public:
+  static SyslogHeader parse(std::string_view frame);
+
+ private:
+  static size_t parsePriority(std::string_view frame, SyslogHeader &header);
+  static bool parseRfc5424(std::string_view frame, size_t pos, SyslogHeader &header);
+  static void parseRfc3164(std::string_view frame, size_t pos, SyslogHeader &header);
+  static size_t skipStructuredData(std::string_view frame, size_t pos);
+};
+
+/*
+ * Converts RFC 3339 ("2003-10-11T22:14:15.003Z") and BSD ("Oct 11 22:14:15") timestamps to
+ * epoch nanoseconds. Consecutive messages of a sender differ only in the last characters,
+ * so the epoch of the date and hour prefix is cached and the fast path only parses minutes,
+ * seconds, fraction and offset. BSD timestamps carry neither year nor zone, they are taken as
+ * local time of the most recent matching date. Keep one instance per connection.
+ */
+class TimestampParser {
+ public:
+  // -1 when the timestamp is missing or malformed
+  int64_t parse(std::string_view timestamp);
+
+ private:
+  std::array<char, 13> prefix_{};
+  size_t prefix_length_ = 0;
+  int64_t prefix_epoch_sec_ = 0;
+
+  int64_t parseRfc3339(std::string_view timestamp);
+  int64_t parseBsd(std::string_view timestamp);
+  bool cached(std::string_view prefix) const;
+  void remember(std::string_view prefix, int64_t epoch_sec);
+};
@@ -1,23 +1,64 @@
 #include "SyslogServer.h"
 
 #include <csignal>
+#include <cstdint>
+#include <thread>
 #include <utility>
 #include <openssl/err.h>
+#ifdef __linux__
+#include <pthread.h>
+#endif
 
 // Initialize static instance pointer
 SyslogServer *SyslogServer::instance_ = nullptr;
 
 SyslogServer::SyslogServer(const std::string &configPath)
-    : config_(configPath), logger_ptr_(std::make_shared<Logger>(config_)) {
+    : config_(configPath),
+      rate_limiter_(config_.getClientRateLimit()),
+      logger_ptr_(std::make_shared<Logger>(config_)) {
   instance_ = this;
   ssl_ctx_ = SSLUtil::createServerContext();
   SSLUtil::initWinSocket();
-  server_socket_ = SSLUtil::createSocket(config_.getServerPort());
+  int listeners = config_.getListeners();
+  for (int i = 0; i < listeners; ++i) {
+    server_sockets_.push_back(SSLUtil::createSocket(config_.getServerPort(), listeners > 1, config_.getListenBacklog()));
+  }
+  if (config_.isCpuSteeringEnabled() && listeners > 1) {
+    // the program is shared by the whole SO_REUSEPORT group, listener i gets the packets of CPU i
+    SSLUtil::attachCpuSteering(server_sockets_.front(), listeners);
+  }
+  if (config_.isIoUringEnabled()) {
+#ifdef SYSLOG_HAVE_IO_URING
+    uring_ = std::make_unique<UringBackend>(config_.getReactorThreads(), server_sockets_, ssl_ctx_, logger_ptr_,
+                                           config_.getFraming(), rate_limiter_);
+#else
+    std::cerr << "io_uring support is not compiled in, ignoring the io_uring option" << std::endl;
+#endif
+  }
+  if (config_.getReactorThreads() > 0 && !config_.isIoUringEnabled()) {
+#ifdef SYSLOG_HAVE_EPOLL
+    reactor_ = std::make_unique<Reactor>(config_.getReactorThreads(), config_.getFairQuantumKb() * 1024);
+#else
+    std::cerr << "reactor_threads needs epoll, using one thread per client" << std::endl;
+#endif
+  }
+#ifdef __linux__
+  // system wide counters, reported relative to the server start
+  uint64_t listen_overflows = Metrics::readNetstat("TcpExt", "ListenOverflows");
+  uint64_t listen_drops = Metrics::readNetstat("TcpExt", "ListenDrops");
+  Metrics::instance().gauge("tcp.listen_overflows", [listen_overflows]() {
+    return Metrics::readNetstat("TcpExt", "ListenOverflows") - listen_overflows;
+  });
+  Metrics::instance().gauge("tcp.listen_drops", [listen_drops]() {
+    return Metrics::readNetstat("TcpExt", "ListenDrops") - listen_drops;
+  });
+#endif
   setupSignals();
   enableVirtualTerminalProcessing();
 }
 
 SyslogServer::~SyslogServer() {
+  Metrics::instance().stop();
   cleanup();
   SSLUtil::cleanWinSocket();
 }
@@ -34,9 +75,14 @@ void SyslogServer::shutdownServer(int sig) {
 
 void SyslogServer::setupSignals() {
   signal(SIGINT, shutdownServer); // Simple signal handler
+#ifndef OPENSSL_SYS_WINDOWS
+  // a client closing mid-write must surface as an I/O error, not kill the server
+  signal(SIGPIPE, SIG_IGN);
+#endif
 }
 
 void SyslogServer::enableVirtualTerminalProcessing() {
+#ifdef OPENSSL_SYS_WINDOWS
   HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
   if (hOut == INVALID_HANDLE_VALUE) {
     return;
@@ -51,6 +97,7 @@ void SyslogServer::enableVirtualTerminalProcessing() {
   if (!SetConsoleMode(hOut, dwMode)) {
     return;
   }
+#endif
 }
 
 void SyslogServer::run() {
@@ -60,20 +107,84 @@ void SyslogServer::run() {
             << std::endl
             << std::endl;
   running_ = true;
-  acceptConnections();
+  Metrics::instance().start(config_.getStatsIntervalSec());
+#ifdef SYSLOG_HAVE_IO_URING
+  if (uring_) {
+    // the rings accept the clients themselves
+    uring_->start();
+    uring_->join();
+    return;
+  }
+#endif
+#ifdef SYSLOG_HAVE_EPOLL
+  if (reactor_) {
+    reactor_->start();
+  }
+#endif
+  // one accept loop per listener, the first one runs on the main thread
+  std::vector<std::thread> acceptors;
+  for (size_t i = 1; i < server_sockets_.size(); ++i) {
+    acceptors.emplace_back([this, i]() {
+      try {
+        acceptConnections(i);
+      } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+      }
+    });
+  }
+  acceptConnections(0);
+  for (auto &acceptor : acceptors) {
+    acceptor.join();
+  }
+#ifdef SYSLOG_HAVE_EPOLL
+  if (reactor_) {
+    reactor_->join();
+  }
+#endif
 }
 
-void SyslogServer::acceptConnections() {
+void SyslogServer::acceptConnections(size_t listener) {
+#if defined(__linux__) && defined(SYSLOG_HAVE_EPOLL)
+  // only with a steering program (several listeners), and only for the reactor: client threads
+  // would inherit the affinity of the accept thread and all share its CPU
+  if (config_.isCpuSteeringEnabled() && server_sockets_.size() > 1 && reactor_) {
+    // accept on the CPU the steering program routes this listener's connections from
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(listener % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  }
+#endif
+  auto &accepted = Metrics::instance().counter("accept.clients");
+  auto &wakeups = Metrics::instance().counter("accept.wakeups");
+  bool non_blocking = false;
+#ifdef SYSLOG_HAVE_EPOLL
+  non_blocking = reactor_ != nullptr;
+#endif
   while (instance_->running_) {
-    int client_socket = SSLUtil::acceptClient(server_socket_);
-    if(client_socket != INVALID_SOCKET) {
+    // the timeout only bounds how long a shutdown can go unnoticed
+    if (!SSLUtil::waitForClients(server_sockets_[listener], 1000))
+      continue;
+    ++wakeups;
+    int client_socket;
+    // drain every pending connection before waiting again
+    while ((client_socket = SSLUtil::acceptClient(server_sockets_[listener], non_blocking)) != INVALID_SOCKET) {
+      ++accepted;
       SSLUtil::setupClient(client_socket);
 
       std::string client_ip = SSLUtil::getClientIP(client_socket);
       std::cout << "Client connected: " << client_ip << std::endl;
       SSL *ssl = SSLUtil::createSSL(ssl_ctx_, client_socket);
       // use shared pointer
-      auto thread = std::make_shared<SyslogServerThread>(ssl, client_socket, client_ip, logger_ptr_);
+      auto thread = std::make_shared<SyslogServerThread>(ssl, client_socket, client_ip, logger_ptr_,
+                                                         config_.getFraming(), rate_limiter_.forClient(client_ip));
+
+#ifdef SYSLOG_HAVE_EPOLL
+      if (reactor_) {
+        reactor_->add(thread);
+        continue;
+      }
+#endif
 
       { // save as weak_ptr to signal later without increasing ownership count
         std::lock_guard<std::mutex> lock(shutdown_mutex_);
@@ -95,75 +206,194 @@ void SyslogServer::cleanup() {
       thread->clientCleanup();
     }
   }
+#ifdef SYSLOG_HAVE_EPOLL
+  if (reactor_) {
+    reactor_->stop();
+  }
+#endif
+#ifdef SYSLOG_HAVE_IO_URING
+  if (uring_) {
+    uring_->stop();
+  }
+#endif
   serverCleanup();
 }
 
 void SyslogServer::serverCleanup() {
-  if (server_socket_ != -1) {
-    std::cout << "Cleaning up server socket..." << std::endl;
-    closesocket(server_socket_);
-    server_socket_ = -1;
+  for (int &server_socket : server_sockets_) {
+    if (server_socket != -1) {
+      std::cout << "Cleaning up server socket..." << std::endl;
+#ifndef OPENSSL_SYS_WINDOWS
+      // closing alone does not wake up a thread blocked in accept() on Linux
+      shutdown(server_socket, SHUT_RDWR);
+#endif
+      closesocket(server_socket);
+      server_socket = -1;
+    }
   }
 }
 
 SyslogServerThread::SyslogServerThread(SSL *ssl,
                                        int client_socket,
                                        std::string client_ip,
-                                       std::shared_ptr<Logger> logger_ptr)
-    : ssl_(ssl), client_socket_(client_socket), client_ip_(std::move(client_ip)), logger_ptr_(std::move(logger_ptr)) {}
+                                       std::shared_ptr<Logger> logger_ptr,
+                                       SyslogFramer::Mode framing,
+                                       std::shared_ptr<ClientRateLimiter::Bucket> rate_limit)
+    : ssl_(ssl), client_socket_(client_socket), client_ip_(std::make_shared<const std::string>(std::move(client_ip))), logger_ptr_(std::move(logger_ptr)),
+      memory_bio_(BIO_method_type(SSL_get_rbio(ssl)) == BIO_TYPE_MEM), framer_(framing),
+      rate_limit_(std::move(rate_limit)) {}
+
 
+bool SyslogServerThread::consume(const char *buffer, size_t len) {
+  if (!framer_.feed(buffer, len, [this](std::string_view frame) { handleFrame(frame); })) {
+    std::cerr << "Invalid syslog framing from " << *client_ip_ << std::endl;
+    return false;
+  }
+  return true;
+}
 
-int SyslogServerThread::extractPriorityDigit(const char* input) {
-  std::string message(input);
-  size_t start = message.find('<') + 1;
-  size_t end = message.find('>');
-  return std::stoi(message.substr(start, end - start)) % 8;
+void SyslogServerThread::handleFrame(std::string_view frame) {
+  if (rate_limit_ && !rate_limit_->admit())
+    return;
+  SyslogHeader header = SyslogParser::parse(frame);
+  logger_ptr_->processMessage(frame, header, timestamp_parser_.parse(header.timestamp.in(frame)), client_ip_);
 }
 
 void SyslogServerThread::handleClient() {
-  char buffer[16 * 1024] = {0};
+  char buffer[16 * 1024];
   int rx_len;
-  size_t message_length;
-  size_t processed_size = 0;
-  // process the message length metadata
-  while ((rx_len = SSL_read(ssl_, buffer, static_cast<int>(sizeof(buffer) - 1))) > 0) {
-    buffer[rx_len] = '\0';
-    size_t data_start_index = 0;
-    if(processed_size == 0) {
-      // the real payload starts after the space
-      data_start_index = std::string(buffer).find(' ') + 1;
-      // -1 removes the space
-      std::string message_length_str = std::string(buffer).substr(0,data_start_index-1);
-      message_length = std::stoi(message_length_str);
-      int priorityDigit = extractPriorityDigit(buffer);
-      logger_ptr_->startColorLine(priorityDigit);
+  for (;;) {
+    // over the rate limit: what the client sends meanwhile waits in the socket buffers
+    auto delay = throttle();
+    if (delay.count() > 0)
+      std::this_thread::sleep_for(delay);
+    if ((rx_len = SSL_read(ssl_, buffer, static_cast<int>(sizeof(buffer)))) <= 0)
+      break;
+    if (!consume(buffer, static_cast<size_t>(rx_len)))
+      return;
+  }
+  if (rx_len != 0) { // 0 is clean disconnect
+    reportReadError(rx_len);
+  }
+}
+
+void SyslogServerThread::reportReadError(int rx_len) {
+  int ssl_err = SSL_get_error(ssl_, rx_len);
+  auto err_err = ERR_get_error();
+  if (ssl_err == SSL_ERROR_SYSCALL) {
+    if (err_err != 0) // 0 is most probably an unexpected timeout/disconnect
+      std::cerr << "Socket I/O error" << std::endl;
+  } else {
+    std::cerr << "SSL " << ERR_error_string(err_err, NULL) << std::endl;
+  }
+}
+
+SyslogServerThread::IoStatus SyslogServerThread::resume(int64_t &deficit) {
+  // the error queue is per thread and shared by every connection of a reactor loop
+  ERR_clear_error();
+  last_activity_ = std::chrono::steady_clock::now();
+  if (state_ == State::Handshake) {
+    int ret = SSL_accept(ssl_);
+    if (ret != 1) {
+      int ssl_err = SSL_get_error(ssl_, ret);
+      if (ssl_err == SSL_ERROR_WANT_READ)
+        return IoStatus::WantRead;
+      if (ssl_err == SSL_ERROR_WANT_WRITE)
+        return IoStatus::WantWrite;
+      return IoStatus::Closed;
     }
-    processed_size += logger_ptr_->processMessage(buffer+data_start_index);
-    if(processed_size >= message_length) {
-      logger_ptr_->endLine(); // SSL_read has finished consuming the message
-      processed_size = 0;
+    state_ = State::Reading;
+  }
+  char buffer[16 * 1024];
+  // bounded so that one busy client cannot starve the other connections of the loop,
+  // a memory BIO has to be drained completely since no readiness event will follow
+  while (deficit > 0 || memory_bio_) {
+    if (!memory_bio_ && (throttle_delay_ = throttle()).count() > 0)
+      return IoStatus::Throttled;
+    int rx_len = SSL_read(ssl_, buffer, static_cast<int>(sizeof(buffer)));
+    if (rx_len > 0) {
+      deficit -= rx_len;
+      if (!consume(buffer, static_cast<size_t>(rx_len)))
+        return IoStatus::Closed;
+      continue;
     }
+    int ssl_err = SSL_get_error(ssl_, rx_len);
+    if (ssl_err == SSL_ERROR_WANT_READ)
+      return IoStatus::WantRead;
+    if (ssl_err == SSL_ERROR_WANT_WRITE)
+      return IoStatus::WantWrite;
+    if (ssl_err != SSL_ERROR_ZERO_RETURN) // clean disconnect
+      reportReadError(rx_len);
+    return IoStatus::Closed;
   }
-  if(rx_len != 0) { // 0 is clean disconnect
-    int ssl_err = SSL_get_error(ssl_,rx_len);
-    auto err_err = ERR_get_error();
-    if(ssl_err == SSL_ERROR_SYSCALL) {
-      if(err_err != 0) // 0 is most probably an unexpected timeout/disconnect
-        std::cerr << "Socket I/O error" << std::endl;
-    } else {
-      std::cerr << "SSL " << ERR_error_string(err_err, NULL) << std::endl;
+  return IoStatus::WantRead;
+}
+
+SyslogServerThread::IoStatus SyslogServerThread::feed(const char *data, size_t len) {
+  if (BIO_write(SSL_get_rbio(ssl_), data, static_cast<int>(len)) != static_cast<int>(len))
+    return IoStatus::Closed;
+  int64_t unlimited = INT64_MAX;
+  return resume(unlimited);
+}
+
+std::string_view SyslogServerThread::pendingOutput() {
+  if (output_.empty() && ssl_) {
+    BIO *wbio = SSL_get_wbio(ssl_);
+    size_t pending = BIO_ctrl_pending(wbio);
+    if (pending > 0) {
+      output_.resize(pending);
+      int len = BIO_read(wbio, output_.data(), static_cast<int>(pending));
+      output_.resize(len > 0 ? static_cast<size_t>(len) : 0);
     }
   }
+  return output_;
+}
+
+void SyslogServerThread::outputSent(size_t len) {
+  output_.erase(0, len);
+}
+
+void SyslogServerThread::flushOutput() {
+  // the close_notify alert on the way out, best effort; with a send in flight it would cut into it
+  if (!output_.empty())
+    return;
+  std::string_view output = pendingOutput();
+#ifndef OPENSSL_SYS_WINDOWS
+  if (!output.empty())
+    send(client_socket_, output.data(), output.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+#endif
+}
+
+int SyslogServerThread::getSocket() const {
+  return client_socket_;
+}
+
+std::chrono::steady_clock::time_point SyslogServerThread::getLastActivity() const {
+  return last_activity_;
+}
+
+void SyslogServerThread::refreshActivity() {
+  last_activity_ = std::chrono::steady_clock::now();
+}
+
+std::chrono::nanoseconds SyslogServerThread::throttle() {
+  return rate_limit_ ? rate_limit_->delay() : std::chrono::nanoseconds(0);
+}
+
+std::chrono::nanoseconds SyslogServerThread::getThrottleDelay() const {
+  return throttle_delay_;
 }
 
 void SyslogServerThread::clientCleanup() {
   if (ssl_) {
     SSL_shutdown(ssl_);
+    if (memory_bio_)
+      flushOutput();
     SSL_free(ssl_);
     ssl_ = nullptr;
   }
   if (client_socket_ != -1) {
-    std::cout << "Client disconnected: " << client_ip_ << std::endl;
+    std::cout << "Client disconnected: " << *client_ip_ << std::endl;
     closesocket(client_socket_);
     client_socket_ = -1;
   }
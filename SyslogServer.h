@@ -1,28 +1,80 @@
 #pragma once
 
+#include <chrono>
+#include <string_view>
 #include <openssl/ssl.h>
 
+#include "ClientRateLimiter.h"
 #include "Config.h"
 #include "SSLUtil.h"
 #include "Logger.h"
+#include "Metrics.h"
+#include "SyslogFramer.h"
+#include "SyslogParser.h"
+#include "Reactor.h"
+#ifdef SYSLOG_HAVE_IO_URING
+#include "UringBackend.h"
+#endif
 
 class SyslogServerThread {
  public:
+  // Throttled: the client is over its rate limit, stop polling it for getThrottleDelay()
+  enum class IoStatus { WantRead, WantWrite, Throttled, Closed };
+
+  // rate_limit is the bucket of the client IP, nullptr without rate limiting
   SyslogServerThread(SSL *ssl,
                      int client_socket,
                      std::string client_ip,
-                     std::shared_ptr<Logger> logger_ptr);
+                     std::shared_ptr<Logger> logger_ptr,
+                     SyslogFramer::Mode framing,
+                     std::shared_ptr<ClientRateLimiter::Bucket> rate_limit);
   void run();
+  /*
+   * Non-blocking counterpart of run(), called by the reactor whenever the socket is ready.
+   * Reads while deficit (bytes, deficit round robin) is positive and takes off what it read;
+   * returns WantRead with deficit still positive once the socket is drained.
+   */
+  IoStatus resume(int64_t &deficit);
+  // Same as resume() for memory BIOs: decrypts the given ciphertext, the TLS output it causes
+  // is left for pendingOutput()
+  IoStatus feed(const char *data, size_t len);
+  // Memory BIOs: the TLS output to send next, stays in place until outputSent()
+  std::string_view pendingOutput();
+  // Memory BIOs: len bytes of pendingOutput() were sent
+  void outputSent(size_t len);
+  int getSocket() const;
+  std::chrono::steady_clock::time_point getLastActivity() const;
+  // Starts the idle timeout over, for a client resumed after a rate limit pause
+  void refreshActivity();
+  // How long to stop reading because of the rate limit, zero when within it
+  std::chrono::nanoseconds throttle();
+  // The delay that made resume() return Throttled
+  std::chrono::nanoseconds getThrottleDelay() const;
   void clientCleanup();
 
  private:
+  enum class State { Handshake, Reading };
+
   SSL *ssl_;
   int client_socket_;
-  std::string client_ip_;
+  std::shared_ptr<const std::string> client_ip_; // handed to the routing table with every record
   std::shared_ptr<Logger> logger_ptr_;
+  State state_ = State::Handshake;
+  bool memory_bio_;
+  std::chrono::steady_clock::time_point last_activity_ = std::chrono::steady_clock::now();
+  // framing state, kept between reads
+  SyslogFramer framer_;
+  TimestampParser timestamp_parser_;
+  std::shared_ptr<ClientRateLimiter::Bucket> rate_limit_;
+  std::chrono::nanoseconds throttle_delay_{0};
+  // memory BIOs: TLS output taken from the write BIO and not sent yet
+  std::string output_;
 
   void handleClient();
-  static int extractPriorityDigit(const char *input);
+  bool consume(const char *buffer, size_t len);
+  void handleFrame(std::string_view frame);
+  void reportReadError(int rx_len);
+  void flushOutput();
 };
 
 class SyslogServer {
@@ -34,10 +86,17 @@ class SyslogServer {
 
  private:
   Config config_;
+  ClientRateLimiter rate_limiter_;
   std::shared_ptr<Logger> logger_ptr_;
   SSL_CTX *ssl_ctx_{};
-  int server_socket_;
+  std::vector<int> server_sockets_;
   std::vector<std::weak_ptr<SyslogServerThread>> threads_;
+#ifdef SYSLOG_HAVE_EPOLL
+  std::unique_ptr<Reactor> reactor_;
+#endif
+#ifdef SYSLOG_HAVE_IO_URING
+  std::unique_ptr<UringBackend> uring_;
+#endif
   std::mutex shutdown_mutex_;
   bool running_{};
 
@@ -46,6 +105,6 @@ class SyslogServer {
 
   static void setupSignals();
   static void enableVirtualTerminalProcessing();
-  void acceptConnections();
+  void acceptConnections(size_t listener);
   void serverCleanup();
 };
@@ -0,0 +1,421 @@
+#include "UringBackend.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "SyslogServer.h"
+
+namespace {
+const unsigned kRingEntries = 1024;
+const unsigned kBufferCount = 256;
+const unsigned kBufferSize = 16 * 1024;
+const uint16_t kBufferGroup = 0;
+// same as the SO_RCVTIMEO used in the thread-per-connection mode
+const std::chrono::seconds kIdleTimeout(60);
+
+// the low byte of user_data is the operation, the rest the connection id
+enum Op : uint64_t { kAccept = 1, kRecv = 2, kTick = 3, kCancel = 4, kProvide = 5, kSend = 6 };
+
+uint64_t tag(uint64_t id, Op op) {
+  return (id << 8) | op;
+}
+
+// multishot receive came with 6.0, the newest feature used; the flags cannot be probed for
+bool kernelSupportsMultishot() {
+  utsname name{};
+  int major = 0;
+  if (uname(&name) != 0 || std::sscanf(name.release, "%d.", &major) != 1)
+    return false;
+  return major >= 6;
+}
+}
+
+struct UringBackend::Ring {
+  int fd = -1;
+  int server_socket = -1;
+  io_uring_params params{};
+  void *sq_ptr = MAP_FAILED;
+  void *cq_ptr = MAP_FAILED;
+  size_t sq_size = 0;
+  size_t cq_size = 0;
+  io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+  unsigned *sq_head = nullptr;
+  unsigned *sq_tail = nullptr;
+  unsigned *sq_array = nullptr;
+  unsigned sq_local_tail = 0;
+  unsigned sq_pending = 0;
+  unsigned *cq_head = nullptr;
+  unsigned *cq_tail = nullptr;
+  io_uring_cqe *cqes = nullptr;
+  // provided buffers, handed back to the kernel as soon as their content is consumed
+  std::vector<char> buffers;
+  __kernel_timespec tick{1, 0};
+  std::thread thread;
+  std::unordered_map<uint64_t, std::shared_ptr<SyslogServerThread>> connections;
+  // connections over their rate limit, without a receive until the given time
+  std::unordered_map<uint64_t, std::chrono::steady_clock::time_point> throttled;
+  // connections with a send in flight, kept alive until it completes since the kernel reads their buffer
+  std::unordered_map<uint64_t, std::shared_ptr<SyslogServerThread>> sending;
+  uint64_t next_id = 1;
+
+  Ring() {
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, kRingEntries, &params));
+    if (fd < 0) {
+      throw std::runtime_error("Unable to create the io_uring instance.");
+    }
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      sq_size = cq_size = std::max(sq_size, cq_size);
+    }
+    sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cq_ptr = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ptr
+        : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqes = static_cast<io_uring_sqe *>(mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe),
+                                            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                            fd, IORING_OFF_SQES));
+    if (sq_ptr == MAP_FAILED || cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+      throw std::runtime_error("Unable to map the io_uring queues.");
+    }
+    auto *sq = static_cast<char *>(sq_ptr);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sq_local_tail = *sq_tail;
+    auto *cq = static_cast<char *>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    buffers.resize(static_cast<size_t>(kBufferCount) * kBufferSize);
+    prepareProvide(0, kBufferCount);
+  }
+
+  ~Ring() {
+    if (sqes != MAP_FAILED)
+      munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+      munmap(cq_ptr, cq_size);
+    if (sq_ptr != MAP_FAILED)
+      munmap(sq_ptr, sq_size);
+    if (fd >= 0)
+      close(fd);
+  }
+
+  io_uring_sqe *getSqe() {
+    if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= params.sq_entries) {
+      // without SQPOLL the kernel consumes every submitted entry during io_uring_enter
+      submit(0);
+    }
+    unsigned index = sq_local_tail & (params.sq_entries - 1);
+    sq_array[index] = index;
+    io_uring_sqe *sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++sq_local_tail;
+    ++sq_pending;
+    return sqe;
+  }
+
+  int submit(unsigned wait_nr) {
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int ret = static_cast<int>(syscall(__NR_io_uring_enter, fd, sq_pending, wait_nr, flags, nullptr, 0));
+    if (ret >= 0)
+      sq_pending = 0;
+    return ret;
+  }
+
+  // Queued with the next submission, so recycling a buffer costs no syscall of its own
+  void prepareProvide(uint16_t bid, unsigned count) {
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<uint64_t>(buffers.data() + static_cast<size_t>(bid) * kBufferSize);
+    sqe->len = kBufferSize;
+    sqe->off = bid;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = tag(0, kProvide);
+  }
+
+  const char *buffer(uint16_t bid) const {
+    return buffers.data() + static_cast<size_t>(bid) * kBufferSize;
+  }
+
+  void prepareAccept(int server_socket) {
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = server_socket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = tag(0, kAccept);
+  }
+
+  void prepareRecv(uint64_t id, int client_socket) {
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client_socket;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = tag(id, kRecv);
+  }
+
+  void prepareSend(uint64_t id, int client_socket, std::string_view data) {
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = client_socket;
+    sqe->addr = reinterpret_cast<uint64_t>(data.data());
+    sqe->len = static_cast<uint32_t>(data.size());
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = tag(id, kSend);
+  }
+
+  void prepareCancel(uint64_t id, Op op) {
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = tag(id, op);
+    sqe->user_data = tag(id, kCancel);
+  }
+
+  void prepareTick() {
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = reinterpret_cast<uint64_t>(&tick);
+    sqe->len = 1;
+    sqe->user_data = tag(0, kTick);
+  }
+};
+
+UringBackend::UringBackend(int threads,
+                           const std::vector<int> &server_sockets,
+                           SSL_CTX *ssl_ctx,
+                           std::shared_ptr<Logger> logger_ptr,
+                           SyslogFramer::Mode framing,
+                           ClientRateLimiter &rate_limiter)
+    : ssl_ctx_(ssl_ctx), logger_ptr_(std::move(logger_ptr)), framing_(framing), rate_limiter_(rate_limiter) {
+  if (!kernelSupportsMultishot()) {
+    throw std::runtime_error("io_uring mode needs Linux 6.0 or newer.");
+  }
+  // at least one ring per listener, so every SO_REUSEPORT socket gets accepted on
+  int count = std::max(threads, static_cast<int>(server_sockets.size()));
+  for (int i = 0; i < count; ++i) {
+    rings_.push_back(std::make_unique<Ring>());
+    rings_.back()->server_socket = server_sockets[i % server_sockets.size()];
+  }
+}
+
+UringBackend::~UringBackend() {
+  stop();
+  join();
+}
+
+void UringBackend::start() {
+  running_ = true;
+  for (auto &ring : rings_) {
+    ring->thread = std::thread(&UringBackend::runLoop, this, std::ref(*ring));
+  }
+}
+
+void UringBackend::stop() {
+  running_ = false;
+}
+
+void UringBackend::join() {
+  for (auto &ring : rings_) {
+    if (ring->thread.joinable()) {
+      ring->thread.join();
+    }
+  }
+}
+
+void UringBackend::runLoop(Ring &ring) {
+  // rings sharing a listening socket get its clients spread by the kernel
+  ring.prepareAccept(ring.server_socket);
+  ring.prepareTick();
+  while (running_) {
+    if (ring.submit(1) < 0 && errno != EINTR && errno != EBUSY) {
+      std::cerr << "io_uring_enter failed: " << std::strerror(errno) << std::endl;
+      break;
+    }
+    unsigned head = *ring.cq_head;
+    unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      io_uring_cqe cqe = ring.cqes[head & (ring.params.cq_entries - 1)];
+      // release the slot before handling, the handler may submit and wait again
+      __atomic_store_n(ring.cq_head, head + 1, __ATOMIC_RELEASE);
+      handleCompletion(ring, cqe.user_data, cqe.res, cqe.flags);
+    }
+  }
+  for (auto &it : ring.connections) {
+    it.second->clientCleanup();
+  }
+  ring.connections.clear();
+}
+
+void UringBackend::handleCompletion(Ring &ring, uint64_t user_data, int res, unsigned flags) {
+  uint64_t id = user_data >> 8;
+  switch (static_cast<Op>(user_data & 0xff)) {
+    case kAccept:
+      if (res >= 0) {
+        acceptClient(ring, res);
+      } else if (!running_) {
+        // stopping shuts the listener down, which ends the accept with EINVAL
+        break;
+      } else if (res == -EINVAL || res == -EBADF) {
+        std::cerr << "io_uring accept stopped: " << std::strerror(-res) << std::endl;
+        break;
+      }
+      if (!(flags & IORING_CQE_F_MORE) && running_)
+        ring.prepareAccept(ring.server_socket);
+      break;
+    case kRecv: {
+      auto it = ring.connections.find(id);
+      bool open = it != ring.connections.end();
+      bool throttled = ring.throttled.count(id) != 0;
+      if (flags & IORING_CQE_F_BUFFER) {
+        auto bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (open && res > 0) {
+          if (it->second->feed(ring.buffer(bid), static_cast<size_t>(res)) == SyslogServerThread::IoStatus::Closed)
+            open = false;
+          else
+            sendOutput(ring, id, it->second);
+        }
+        ring.prepareProvide(bid, 1);
+      }
+      // 0 is a clean disconnect, ENOBUFS only means the buffer ring ran dry for a moment
+      // and ECANCELED of a throttled connection is our own doing
+      if (res == 0 || (res < 0 && res != -ENOBUFS && !(res == -ECANCELED && throttled)))
+        open = false;
+      if (!open) {
+        closeConnection(ring, id);
+        break;
+      }
+      if (!throttled) {
+        auto delay = it->second->throttle();
+        if (delay.count() > 0) {
+          // what is already in flight still arrives, the rest waits in the socket buffers
+          ring.throttled[id] = std::chrono::steady_clock::now() + delay;
+          throttled = true;
+          if (flags & IORING_CQE_F_MORE)
+            ring.prepareCancel(id, kRecv);
+        }
+      }
+      if (!throttled && !(flags & IORING_CQE_F_MORE)) {
+        ring.prepareRecv(id, it->second->getSocket());
+      }
+      break;
+    }
+    case kTick:
+      closeIdleConnections(ring);
+      resumeThrottled(ring);
+      if (running_)
+        ring.prepareTick();
+      break;
+    case kProvide:
+      if (res < 0)
+        std::cerr << "io_uring could not provide receive buffers: " << std::strerror(-res) << std::endl;
+      break;
+    case kSend: {
+      auto sending = ring.sending.find(id);
+      if (sending == ring.sending.end())
+        break;
+      std::shared_ptr<SyslogServerThread> connection = std::move(sending->second);
+      ring.sending.erase(sending);
+      auto it = ring.connections.find(id);
+      if (it == ring.connections.end()) // closed while sending
+        break;
+      if (res < 0) {
+        closeConnection(ring, id);
+        break;
+      }
+      connection->outputSent(static_cast<size_t>(res));
+      sendOutput(ring, id, connection);
+      break;
+    }
+    case kCancel:
+      break;
+  }
+}
+
+void UringBackend::sendOutput(Ring &ring, uint64_t id, const std::shared_ptr<SyslogServerThread> &connection) {
+  // one send at a time per connection, the records have to go out in order
+  if (ring.sending.count(id) != 0)
+    return;
+  std::string_view output = connection->pendingOutput();
+  if (output.empty())
+    return;
+  ring.sending[id] = connection;
+  ring.prepareSend(id, connection->getSocket(), output);
+}
+
+void UringBackend::acceptClient(Ring &ring, int client_socket) {
+  static auto &accepted = Metrics::instance().counter("accept.clients");
+  ++accepted;
+  try {
+    SSLUtil::setupClient(client_socket);
+    std::string client_ip = SSLUtil::getClientIP(client_socket);
+    std::cout << "Client connected: " << client_ip << std::endl;
+    SSL *ssl = SSLUtil::createMemorySSL(ssl_ctx_);
+    auto connection = std::make_shared<SyslogServerThread>(ssl, client_socket, client_ip, logger_ptr_, framing_,
+                                                           rate_limiter_.forClient(client_ip));
+    uint64_t id = ring.next_id++;
+    ring.connections[id] = connection;
+    ring.prepareRecv(id, client_socket);
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    closesocket(client_socket);
+  }
+}
+
+void UringBackend::closeConnection(Ring &ring, uint64_t id) {
+  auto it = ring.connections.find(id);
+  if (it == ring.connections.end())
+    return;
+  // the multishot receive holds its own reference on the socket, closing is not enough
+  ring.prepareCancel(id, kRecv);
+  ring.prepareCancel(id, kSend);
+  it->second->clientCleanup();
+  ring.connections.erase(it);
+  ring.throttled.erase(id);
+}
+
+void UringBackend::closeIdleConnections(Ring &ring) {
+  auto deadline = std::chrono::steady_clock::now() - kIdleTimeout;
+  std::vector<uint64_t> idle;
+  for (const auto &it : ring.connections) {
+    // a paused client is not idle, its timeout starts over when it is resumed
+    if (ring.throttled.count(it.first) == 0 && it.second->getLastActivity() < deadline) {
+      idle.push_back(it.first);
+    }
+  }
+  for (uint64_t id : idle) {
+    closeConnection(ring, id);
+  }
+}
+
+void UringBackend::resumeThrottled(Ring &ring) {
+  auto now = std::chrono::steady_clock::now();
+  for (auto it = ring.throttled.begin(); it != ring.throttled.end();) {
+    auto connection = ring.connections.find(it->first);
+    if (it->second > now && connection != ring.connections.end()) {
+      ++it;
+      continue;
+    }
+    if (connection != ring.connections.end()) {
+      connection->second->refreshActivity();
+      ring.prepareRecv(it->first, connection->second->getSocket());
+    }
+    it = ring.throttled.erase(it);
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+#include "ClientRateLimiter.h"
+#include "SyslogFramer.h"
+
+class Logger;
+class SyslogServerThread;
+
+/*
+ * io_uring alternative to the epoll reactor: every loop thread owns a ring with a
+ * multishot accept on one of the listening sockets and one multishot receive per client that
+ * picks its buffers from a pool provided to the kernel. Received ciphertext is handed to
+ * OpenSSL through memory BIOs, so decrypting needs no syscall of its own. A client over its
+ * rate limit gets its receive cancelled, and submitted again on the first tick after the delay.
+ * TLS output goes out with IORING_OP_SEND, one send in flight per connection, so a slow peer never
+ * blocks the loop.
+ * Talks to the kernel directly (linux/io_uring.h), needs Linux 6.0 or newer.
+ */
+class UringBackend {
+ public:
+  UringBackend(int threads,
+               const std::vector<int> &server_sockets,
+               SSL_CTX *ssl_ctx,
+               std::shared_ptr<Logger> logger_ptr,
+               SyslogFramer::Mode framing,
+               ClientRateLimiter &rate_limiter);
+  ~UringBackend();
+  void start();
+  // Only sets a flag, the loops notice it on their next periodic tick
+  void stop();
+  void join();
+
+ private:
+  struct Ring;
+
+  std::vector<std::unique_ptr<Ring>> rings_;
+  SSL_CTX *ssl_ctx_;
+  std::shared_ptr<Logger> logger_ptr_;
+  SyslogFramer::Mode framing_;
+  ClientRateLimiter &rate_limiter_;
+  std::atomic<bool> running_{false};
+
+  void runLoop(Ring &ring);
+  void handleCompletion(Ring &ring, uint64_t user_data, int res, unsigned flags);
+  void acceptClient(Ring &ring, int client_socket);
+  void sendOutput(Ring &ring, uint64_t id, const std::shared_ptr<SyslogServerThread> &connection);
+  void closeConnection(Ring &ring, uint64_t id);
+  void closeIdleConnections(Ring &ring);
+  void resumeThrottled(Ring &ring);
+};
@@ -0,0 +1,113 @@
+// JSON line throughput: the escaper and the json preset of OutputTemplate against a byte
+// by byte escaper and against building the same object with nlohmann::json, one thread.
+// Build with -DSYSLOG_BUILD_BENCHMARKS=ON, run bin/bench_json [rounds]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.hpp"
+#include "LogRecord.h"
+#include "OutputTemplate.h"
+#include "SyslogParser.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+// one byte at a time, the way OutputTemplate escaped before SimdScan
+void appendJsonScalar(std::string_view value, std::string &out) {
+  static const char hex[] = "0123456789abcdef";
+  size_t clean = 0;
+  for (size_t i = 0; i < value.size(); ++i) {
+    auto c = static_cast<unsigned char>(value[i]);
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    out.append(value.data() + clean, i - clean);
+    clean = i + 1;
+    out += '\\';
+    switch (c) {
+      case '"': out += '"'; break;
+      case '\\': out += '\\'; break;
+      case '\n': out += 'n'; break;
+      case '\r': out += 'r'; break;
+      case '\t': out += 't'; break;
+      default:
+        out += "u00";
+        out += hex[c >> 4];
+        out += hex[c & 0xf];
+    }
+  }
+  out.append(value.data() + clean, value.size() - clean);
+}
+
+template<typename Line>
+void run(const char *name, int rounds, size_t count, Line line) {
+  std::string out;
+  size_t bytes = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    out.clear();
+    for (size_t i = 0; i < count; ++i)
+      line(i, out);
+    bytes += out.size();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << name << ": " << static_cast<double>(count) * rounds / seconds / 1e6 << " M lines/s, "
+            << bytes / seconds / 1e6 << " MB/s" << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  int rounds = argc > 1 ? std::max(1, std::atoi(argv[1])) : 1000;
+  std::vector<std::string> messages;
+  for (int i = 0; i < 1000; ++i) {
+    messages.push_back("<134>1 2026-10-17T10:11:12.003Z host" + std::to_string(i % 10) +
+                       " app 123 ID47 - Accepted publickey for deploy from 10.0.4." + std::to_string(i % 250) +
+                       " port 51234 ssh2: ED25519 SHA256:Zk3c9a7bQ \"quoted\" request path=/api/v1/items?id=" +
+                       std::to_string(i) + " took 12ms");
+  }
+  std::vector<SyslogHeader> headers;
+  std::vector<LogRecord> records;
+  for (const std::string &message : messages) {
+    headers.push_back(SyslogParser::parse(message));
+    LogRecord record;
+    record.frame = FrameRef::create(message);
+    record.severity = 6;
+    record.timestamp_ns = 1792000000000000000LL;
+    records.push_back(std::move(record));
+  }
+
+  run("msg escape, byte by byte", rounds, messages.size(), [&](size_t i, std::string &out) {
+    appendJsonScalar(headers[i].message.in(messages[i]), out);
+  });
+  run("msg escape, SimdScan    ", rounds, messages.size(), [&](size_t i, std::string &out) {
+    OutputTemplate::appendJson(headers[i].message.in(messages[i]), out);
+  });
+  OutputTemplate json_template("json");
+  run("json preset line        ", rounds, messages.size(), [&](size_t i, std::string &out) {
+    json_template.format(records[i], out);
+  });
+  run("nlohmann::json dump()   ", rounds, messages.size(), [&](size_t i, std::string &out) {
+    std::string_view frame = messages[i];
+    SyslogHeader header = SyslogParser::parse(frame);
+    json line;
+    line["timestamp"] = "2026-10-17T10:11:12.003000Z";
+    line["host"] = header.hostname.in(frame);
+    line["app"] = header.app_name.in(frame);
+    line["procid"] = header.procid.in(frame);
+    line["msgid"] = header.msgid.in(frame);
+    line["facility"] = "local0";
+    line["severity"] = "info";
+    line["client_ip"] = "";
+    line["msg"] = header.message.in(frame);
+    out += line.dump();
+    out += '\n';
+  });
+  return 0;
+}
@@ -0,0 +1,93 @@
+// Rule engine throughput: one thread evaluating a rule set of typical size against
+// RFC 5424 messages, see the rules option in config.json.
+// Build with -DSYSLOG_BUILD_BENCHMARKS=ON, run bin/bench_rules [rounds]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "RuleEngine.h"
+#include "SyslogParser.h"
+
+namespace {
+
+// 100 rules on host, app, prefix, literal and severity, then one regex rule
+std::vector<RuleConfig> makeRules(bool gate_regex) {
+  std::vector<RuleConfig> rules;
+  for (int i = 0; i < 100; ++i) {
+    RuleConfig rule;
+    rule.name = "r" + std::to_string(i);
+    rule.action = RuleAction::Drop;
+    switch (i % 5) {
+      case 0: rule.hosts = {"host" + std::to_string(100 + i)}; break;
+      case 1: rule.app_names = {"app" + std::to_string(i)}; break;
+      case 2: rule.msg_prefixes = {"prefix" + std::to_string(i) + " "}; break;
+      case 3: rule.msg_contains = {"needle" + std::to_string(i), "marker" + std::to_string(i)}; break;
+      case 4:
+        rule.facility = 23;
+        rule.min_severity = rule.max_severity = 7;
+        rule.msg_contains = {"debug" + std::to_string(i)};
+        break;
+    }
+    rules.push_back(rule);
+  }
+  RuleConfig regex;
+  regex.name = "regex";
+  regex.action = RuleAction::Rewrite;
+  regex.severity = 3;
+  regex.msg_regex = "Failed password for (invalid user )?\\w+ from [0-9.]+";
+  if (gate_regex)
+    regex.msg_contains = {"Failed password"};
+  rules.push_back(regex);
+  return rules;
+}
+
+std::vector<std::string> makeMessages() {
+  const char *texts[] = {
+      "Accepted publickey for deploy from 10.0.4.%d port 51234 ssh2",
+      "Failed password for invalid user admin from 10.0.9.%d port 40022 ssh2",
+      "GET /api/v1/items?id=%d 200 12ms",
+      "connection from 192.168.1.%d closed by peer"};
+  std::vector<std::string> messages;
+  char text[128];
+  for (int i = 0; i < 1000; ++i) {
+    std::snprintf(text, sizeof(text), texts[i % 4], i % 250);
+    messages.push_back("<134>1 2026-10-17T10:11:12.003Z host" + std::to_string(i % 10) + " app" +
+                       std::to_string(i % 7 + 200) + " 123 ID47 - " + text);
+  }
+  return messages;
+}
+
+void run(const char *name, bool gate_regex, int rounds) {
+  std::vector<RuleConfig> configs = makeRules(gate_regex);
+  RuleEngine engine(configs);
+  std::vector<std::string> messages = makeMessages();
+  std::vector<SyslogHeader> headers;
+  for (const std::string &message : messages)
+    headers.push_back(SyslogParser::parse(message));
+  const std::string client_ip = "10.0.4.1";
+  size_t matched = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    for (size_t i = 0; i < messages.size(); ++i) {
+      matched += engine.evaluate(messages[i], headers[i], &client_ip).action != RuleAction::Keep;
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double per_sec = static_cast<double>(messages.size()) * rounds / seconds;
+  std::cout << name << ": " << per_sec / 1e6 << " M messages/s, " << per_sec * configs.size() / 1e6
+            << " M rule evaluations/s (" << configs.size() << " rules, " << matched << " matches)" << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  int rounds = argc > 1 ? std::max(1, std::atoi(argv[1])) : 2000;
+  run("regex gated by a literal", true, rounds);
+  run("regex on every message  ", false, rounds / 4 + 1);
+  return 0;
+}